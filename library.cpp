@@ -0,0 +1,4094 @@
+#include "library_internal.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+#ifndef _WIN32
+#include <signal.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#define CRC32C_HARDWARE 1
+#else
+#define CRC32C_HARDWARE 0
+#endif
+
+deque<BookSlot> bookSlab;
+int32_t freeBookSlot = -1;
+unordered_map<int, BookHandle> bookHandleByID;
+BookList fictionBooks(0);
+BookList nonFictionBooks(1);
+BookList scienceBooks(2);
+BookList mysteryBooks(3);
+BookList romanceBooks(4);
+BookList biographyBooks(5);
+BookList historyBooks(6);
+BookList technologyBooks(7);
+BookList childrenBooks(8);
+BookList artBooks(9);
+vector<Borrower> borrowers;
+vector<BorrowedBookDetails> loanRecords;
+vector<OverflowLoan> loanOverflow;
+int32_t overflowFreeList = -1;
+BorrowerStore borrowerStore;
+BookRecordFile bookRecords;
+LoanJournal loanJournal;
+TextStamp booksTextStamp;
+TextStamp borrowersTextStamp;
+SharedCatalog sharedCatalog;
+array<SortOrders, 10> categorySortOrders;
+SortOrders catalogSortOrders;
+BookList* const categoryLists[10] = {&fictionBooks, &nonFictionBooks, &scienceBooks, &mysteryBooks, &romanceBooks,
+                                         &biographyBooks, &historyBooks, &technologyBooks, &childrenBooks, &artBooks};
+IdBitmap uniqueBookIDs;
+IdBitmap uniqueBorrowerIDs;
+unordered_map<int, BorrowerStats> borrowerStats;
+unordered_map<int, BookStats> bookStats;
+map<int, vector<DueEntry>> dueWheel;
+multimap<tuple<int, int, int>, int> scheduledDueDays;
+map<int, IntervalBucket> loanIntervals;
+set<int> openIntervalBuckets;
+int32_t longestClosedLoan = 0;
+vector<NameKey> borrowerNameIndex;
+vector<TitleEntry> titleIndex;
+bool titleIndexDirty = true;
+unordered_map<int, CoBorrowRow> coBorrowIndex;
+bool coBorrowDirty = true;
+shared_ptr<const LibrarySnapshot> currentSnapshot = make_shared<LibrarySnapshot>();
+array<SnapshotTracker, 10> categoryTrackers;
+SnapshotTracker borrowerTracker;
+mutex snapshotWriteMutex;
+uint64_t renderVersionClock = 0;
+array<uint64_t, 10> categoryVersions = {};
+unordered_map<int, uint64_t> borrowerVersions;
+uint64_t titleVersion = 0;
+WatchedFile watchedBooks = {BOOKS_FILE, bookLineID};
+WatchedFile watchedBorrowers = {BORROWERS_FILE, borrowerLineID};
+mutex reloadMutex;
+thread fileWatcher;
+atomic<bool> watcherStopping(false);
+ChangeCapture changeCapture;
+TraceLog traceLog;
+mutex noticeMutex;                     // The watcher thread reports too
+vector<string> pendingNotices;
+
+// Queues a message for the user; the frontend shows them at a moment of its choosing
+void libraryNotice(const string& text) {
+    lock_guard<mutex> lock(noticeMutex);
+    pendingNotices.push_back(text);
+}
+
+vector<string> takeLibraryNotices() {
+    lock_guard<mutex> lock(noticeMutex);
+    vector<string> notices;
+    notices.swap(pendingNotices);
+    return notices;
+}
+
+thread_local TraceBuffer* threadTrace = nullptr;
+
+int64_t traceNow() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - traceLog.epoch).count();
+}
+
+TraceBuffer& threadTraceBuffer() {
+    if (!threadTrace) {
+        lock_guard<mutex> lock(traceLog.buffersMutex);
+        traceLog.buffers.emplace_back();
+        threadTrace = &traceLog.buffers.back();
+        threadTrace->tid = int(traceLog.buffers.size());
+    }
+    return *threadTrace;
+}
+
+// Starts recording spans; every thread's spans go into the same timeline
+void startTracing(const string& path) {
+    traceLog.path = path;
+    traceLog.epoch = chrono::steady_clock::now();
+    traceLog.enabled = true;
+    nameTraceThread("main");
+}
+
+// Labels the calling thread's row in the timeline
+void nameTraceThread(const string& name) {
+    if (!traceLog.enabled.load(memory_order_relaxed)) return;
+    TraceBuffer& buffer = threadTraceBuffer();
+    lock_guard<mutex> lock(buffer.lock);
+    buffer.threadName = name;
+}
+
+TraceSpan::TraceSpan(const char* spanName) : name(spanName), start(traceLog.enabled.load(memory_order_relaxed) ? traceNow() : -1) {}
+
+TraceSpan::~TraceSpan() {
+    if (start < 0) return;
+    int64_t end = traceNow();
+    TraceBuffer& buffer = threadTraceBuffer();
+    lock_guard<mutex> lock(buffer.lock);
+    buffer.events.push_back({name, start, end - start});
+}
+
+// Chrome trace-event JSON: one complete ("X") event per span, plus a name for each thread.
+// Spans recorded so far are kept, so a later call writes them again along with the new ones.
+bool writeTrace(const string& path, string& error) {
+    ostringstream json;
+    json << "{\"traceEvents\":[";
+    const char* separator = "\n";
+    int pid = int(getpid());
+    {
+        lock_guard<mutex> lock(traceLog.buffersMutex);
+        for (auto& buffer : traceLog.buffers) {
+            lock_guard<mutex> bufferLock(buffer.lock);
+            if (!buffer.threadName.empty()) {
+                json << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer.tid
+                     << ",\"args\":{\"name\":\"" << jsonEscape(buffer.threadName) << "\"}}";
+                separator = ",\n";
+            }
+            for (const auto& event : buffer.events) {
+                json << separator << "{\"name\":\"" << jsonEscape(event.name) << "\",\"cat\":\"library\",\"ph\":\"X\",\"ts\":" << event.start
+                     << ",\"dur\":" << event.duration << ",\"pid\":" << pid << ",\"tid\":" << buffer.tid << "}";
+                separator = ",\n";
+            }
+        }
+    }
+    json << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    ofstream out(path, ios::binary);
+    if (!out.is_open()) {
+        error = "Error opening " + path + " for writing.";
+        return false;
+    }
+    out << json.str();
+    return true;
+}
+
+bool isValidDate(const string& date) {
+    if (date.size() != 10 || date[4] != '-' || date[7] != '-') {
+        return false;
+    }
+
+    int year, month, day;
+    if (sscanf(date.c_str(), "%d-%d-%d", &year, &month, &day) != 3) {
+        return false;
+    }
+
+    if (year < 1900 || year > 2100 || month < 1 || month > 12 || day < 1 || day > 31) {
+        return false;
+    }
+
+    if ((month == 4 || month == 6 || month == 9 || month == 11) && day > 30) {
+        return false;
+    }
+
+    if (month == 2) {
+        bool isLeap = (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
+        if (day > (isLeap ? 29 : 28)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool saveBooks() {
+    TraceSpan span("saveBooks");
+    beginSelfWrite(watchedBooks);
+    ofstream outFile(BOOKS_FILE, ios::binary);
+    bool opened = outFile.is_open();
+    if (opened) {
+        // Written in one piece, so the checksums cover exactly the bytes on disk
+        ostringstream content;
+        {
+            TraceSpan serialize("serialize books");
+            for (uint8_t c = 0; c < 10; ++c) {
+                for (const auto& book : *categoryLists[c]) {
+                    content << bookLine(book, c) << "\n";
+                }
+            }
+        }
+        string text = content.str();
+        {
+            TraceSpan write("write books.txt");
+            outFile << text;
+            outFile.close();
+        }
+        writeChecksumFile(BOOKS_FILE, text);
+        booksTextStamp = textStampOf(text);
+        bookRecords.setTextStamp(booksTextStamp); // Its copy counts now follow the file just written
+    } else {
+        libraryNotice("Error opening books file for writing.\n");
+    }
+    endSelfWrite(watchedBooks);
+    return opened;
+}
+
+void loadBooks() {
+    TraceSpan span("loadBooks");
+    ifstream inFile(BOOKS_FILE, ios::binary);
+    if (inFile.is_open()) {
+        string content = readWholeFile(inFile);
+        inFile.close();
+        verifyChecksumFile(BOOKS_FILE, content);
+        booksTextStamp = textStampOf(content);
+        istringstream lines(content);
+        loadBookLines(lines, BOOKS_FILE);
+    } else {
+        libraryNotice("Error opening books file for reading.\n");
+    }
+}
+
+// Files every books.txt line, whether it comes from the file or the shared catalog
+void loadBookLines(istream& in, const string& source) {
+    TraceSpan span("parse books");
+    string line;
+    size_t lineNumber = 0, errors = 0;
+    vector<int> loadedIDs; // Filed into uniqueBookIDs in one pass at the end
+    while (getline(in, line)) {
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+
+        Book book;
+        int category = parseBookLine(line, book);
+        if (category < 0) {
+            reportLoadError(source, lineNumber, "not a valid \"Category,ID,Title,Copies\" record", errors);
+            continue;
+        }
+
+        // Add book to the appropriate category
+        categoryLists[category]->push_back(book);
+        loadedIDs.push_back(book.id);
+        watchedBooks.image[book.id] = recordHash(line);
+    }
+    reportLoadErrorTotal(source, errors);
+    {
+        TraceSpan ids("build uniqueBookIDs");
+        for (int id : loadedIDs) uniqueBookIDs.insert(id);
+    }
+    titleIndexDirty = true;
+    for (auto& tracker : categoryTrackers) tracker.dirtyFrom = 0;
+    rebuildSortOrders();
+}
+
+// Splits a books.txt line; returns the index of the category list it belongs in, or -1
+// when the category is unknown or the line is malformed
+int parseBookLine(const string& line, Book& book) {
+    stringstream ss(line);
+    string category;
+    getline(ss, category, ',');
+    ss >> book.id;
+    ss.ignore();  // Ignore the comma
+    getline(ss, book.title, ',');
+    ss >> book.copies;
+    if (!ss.eof() && ss.peek() == ',') {
+        ss.ignore();
+        ss >> book.owned; // Optional fifth column; older files stop at copies
+    }
+    if (ss.fail() || book.id <= 0) return -1;
+
+    if (category == "Fiction") return 0;
+    if (category == "NonFiction") return 1;
+    if (category == "Science Fiction & Fantasy") return 2;
+    if (category == "Mystery & Thriller") return 3;
+    if (category == "Romance") return 4;
+    if (category == "Biography & Autobiography") return 5;
+    if (category == "History") return 6;
+    if (category == "Science & Technology") return 7;
+    if (category == "Children's Book") return 8;
+    if (category == "Art & Design") return 9;
+    return -1;
+}
+
+BookHandle BookList::push_back(const Book& book) {
+    uint32_t slot;
+    if (freeBookSlot >= 0) {
+        slot = uint32_t(freeBookSlot);
+        freeBookSlot = bookSlab[slot].nextFree;
+    } else {
+        slot = uint32_t(bookSlab.size());
+        bookSlab.emplace_back();
+    }
+
+    BookSlot& entry = bookSlab[slot];
+    entry.book = book;
+    entry.nextFree = -1;
+    entry.category = category;
+    entry.position = uint32_t(handles.size());
+
+    BookHandle handle{slot, entry.generation};
+    handles.push_back(handle);
+    bookHandleByID[book.id] = handle;
+    bumpCategoryVersion(category);
+    bumpTitleVersion();
+    return handle;
+}
+
+// Retires the slot, so any loan still holding its handle stops resolving
+void BookList::erase(iterator it) {
+    size_t position = size_t(it.at - handles.data());
+    uint32_t slot = handles[position].slot;
+    BookSlot& entry = bookSlab[slot];
+
+    auto indexed = bookHandleByID.find(entry.book.id);
+    if (indexed != bookHandleByID.end() && indexed->second.slot == slot) bookHandleByID.erase(indexed);
+    entry.book = Book();
+    entry.generation++;
+    entry.nextFree = freeBookSlot;
+    freeBookSlot = int32_t(slot);
+
+    handles.erase(handles.begin() + position);
+    for (size_t i = position; i < handles.size(); ++i) {
+        bookSlab[handles[i].slot].position = uint32_t(i);
+    }
+    bumpCategoryVersion(category);
+    bumpTitleVersion();
+}
+
+Book* resolveBook(BookHandle handle) {
+    if (handle.slot >= bookSlab.size() || bookSlab[handle.slot].generation != handle.generation) return nullptr;
+    return &bookSlab[handle.slot].book;
+}
+
+BookHandle findBookHandle(int bookID) {
+    auto found = bookHandleByID.find(bookID);
+    return found == bookHandleByID.end() ? BookHandle() : found->second;
+}
+
+// Deleted books fall back to the standard rule
+const CategoryFeeRule& feeRuleFor(BookHandle book) {
+    return resolveBook(book) ? categoryFeeRules[bookSlab[book.slot].category] : categoryFeeRules[0];
+}
+
+string serializeBorrower(const Borrower& borrower, const BorrowedBookDetails* loanBase) {
+    ostringstream out;
+    out << borrower.id << "," << borrower.lastName << "," << borrower.firstName << ","
+        << borrower.middleInitial << ",";
+
+    LoanRange loans = loansOf(borrower, loanBase);
+    if (loans.empty()) {
+        out << "~~~";
+    } else {
+        // Save borrowed book details
+        bool first = true;
+        for (const auto& book : loans) {
+            if (!first) out << "~";
+            out << book.id << "~" << dateFromDays(book.borrowDay) << "~" << returnDateText(book) << "~" << book.overdueFee;
+            first = false;
+        }
+    }
+    return out.str();
+}
+
+// Appends the borrower's loans to the given array and records their range in the borrower
+Borrower parseBorrowerLine(const string& line, vector<BorrowedBookDetails>& loans) {
+    stringstream ss(line);
+    Borrower borrower;
+    string borrowedBookID, dateBorrow, dateReturn, strOverdueFee;
+
+    size_t loanStart = loans.size();
+    ss >> borrower.id;
+    ss.ignore();  // Ignore the comma
+    getline(ss, borrower.lastName, ',');
+    getline(ss, borrower.firstName, ',');
+    getline(ss, borrower.middleInitial, ',');
+
+    // Read borrowed book details
+    while (getline(ss, borrowedBookID, '~')) {
+        if (borrowedBookID.length() == 0) break; // No borrowed books
+        getline(ss, dateBorrow, '~');
+        getline(ss, dateReturn, '~');
+        getline(ss, strOverdueFee, '~');
+        if (!isValidDate(dateBorrow) || (!dateReturn.empty() && !isValidDate(dateReturn))) {
+            throw invalid_argument("loan date");
+        }
+
+        BorrowedBookDetails borrowedBook;
+        borrowedBook.id = stoi(borrowedBookID);
+        borrowedBook.borrowDay = daysFromDate(dateBorrow);
+        borrowedBook.returnDay = dateReturn.empty() ? NOT_RETURNED : daysFromDate(dateReturn);
+        borrowedBook.book = findBookHandle(borrowedBook.id);
+        try {
+            borrowedBook.overdueFee = stoi(strOverdueFee);
+        } catch (const invalid_argument& e) {
+            borrowedBook.overdueFee = 0; // Default to 0 if conversion fails
+        }
+
+        loans.push_back(borrowedBook);
+    }
+    borrower.loanBegin = uint32_t(loanStart);
+    borrower.loanCount = uint32_t(loans.size() - loanStart);
+    return borrower;
+}
+
+// parseBorrowerLine() for text that may be damaged: false, with any loans it appended taken
+// back, when the ID is missing or a loan cannot be read
+bool parseBorrowerRecord(const string& line, vector<BorrowedBookDetails>& loans, Borrower& borrower) {
+    size_t loanStart = loans.size();
+    try {
+        borrower = parseBorrowerLine(line, loans);
+        if (borrower.id > 0) return true;
+    } catch (const exception& e) {
+        // Unreadable book ID or date
+    }
+    loans.resize(loanStart);
+    return false;
+}
+
+LoanRange loansOf(const Borrower& borrower, const BorrowedBookDetails* loanBase) {
+    const BorrowedBookDetails* base = loanBase ? loanBase : loanRecords.data();
+    uint32_t end = borrower.loanBegin + borrower.loanCount;
+    return {{base, borrower.loanBegin, end, borrower.overflowHead}, {base, end, end, -1}};
+}
+
+void appendLoan(Borrower& borrower, const BorrowedBookDetails& loan) {
+    int32_t slot;
+    if (overflowFreeList >= 0) {
+        slot = overflowFreeList;
+        overflowFreeList = loanOverflow[slot].next;
+        loanOverflow[slot] = {loan, -1};
+    } else {
+        slot = int32_t(loanOverflow.size());
+        loanOverflow.push_back({loan, -1});
+    }
+
+    if (borrower.overflowTail >= 0) loanOverflow[borrower.overflowTail].next = slot;
+    else borrower.overflowHead = slot;
+    borrower.overflowTail = slot;
+}
+
+BorrowedBookDetails* findOpenLoan(Borrower& borrower, int bookID) {
+    for (uint32_t i = borrower.loanBegin; i < borrower.loanBegin + borrower.loanCount; ++i) {
+        if (loanRecords[i].id == bookID && loanRecords[i].returnDay == NOT_RETURNED) return &loanRecords[i];
+    }
+    for (int32_t slot = borrower.overflowHead; slot >= 0; slot = loanOverflow[slot].next) {
+        BorrowedBookDetails& loan = loanOverflow[slot].loan;
+        if (loan.id == bookID && loan.returnDay == NOT_RETURNED) return &loan;
+    }
+    return nullptr;
+}
+
+// Hands a borrower's overflow loans back to the free list (used when the store evicts them)
+void releaseOverflowLoans(Borrower& borrower) {
+    if (borrower.overflowHead < 0) return;
+    loanOverflow[borrower.overflowTail].next = overflowFreeList;
+    overflowFreeList = borrower.overflowHead;
+    borrower.overflowHead = borrower.overflowTail = -1;
+}
+
+// Rebuilds the loan array in borrower order with every overflow chain folded back in
+void compactLoans() {
+    TraceSpan span("compactLoans");
+    vector<BorrowedBookDetails> packed;
+    packed.reserve(loanRecords.size() + loanOverflow.size());
+    for (auto& borrower : borrowers) {
+        uint32_t begin = uint32_t(packed.size());
+        for (const auto& loan : loansOf(borrower)) packed.push_back(loan);
+        borrower.loanBegin = begin;
+        borrower.loanCount = uint32_t(packed.size() - begin);
+        borrower.overflowHead = borrower.overflowTail = -1;
+    }
+    loanRecords.swap(packed);
+    vector<OverflowLoan>().swap(loanOverflow);
+    overflowFreeList = -1;
+}
+
+string returnDateText(const BorrowedBookDetails& loan) {
+    return loan.returnDay == NOT_RETURNED ? "" : dateFromDays(loan.returnDay);
+}
+
+Borrower* findBorrower(int borrowerID) {
+    if (borrowerStore.enabled()) return borrowerStore.get(borrowerID);
+
+    auto it = find_if(borrowers.begin(), borrowers.end(), [borrowerID](const Borrower& b) {
+        return b.id == borrowerID;
+    });
+    return it == borrowers.end() ? nullptr : &*it;
+}
+
+bool saveBorrowers() {
+    TraceSpan span("saveBorrowers");
+    beginSelfWrite(watchedBorrowers);
+    ofstream outFile(BORROWERS_FILE, ios::binary);
+    bool opened = outFile.is_open();
+    if (opened) {
+        if (borrowerStore.enabled()) borrowerStore.flush();
+        else compactLoans();
+        string content;
+        {
+            TraceSpan serialize("serialize borrowers");
+            forEachBorrower([&](const Borrower& borrower, const BorrowedBookDetails* loanBase) {
+                content += serializeBorrower(borrower, loanBase);
+                content += "\n";
+            });
+        }
+        {
+            TraceSpan write("write borrowers.txt");
+            outFile << content;
+            outFile.close();
+        }
+        writeChecksumFile(BORROWERS_FILE, content);
+        borrowersTextStamp = textStampOf(content);
+        loanJournal.restart(borrowersTextStamp); // Every journaled loan is in the file now
+    } else {
+        libraryNotice("Error opening borrowers file for writing.\n");
+    }
+    endSelfWrite(watchedBorrowers);
+    return opened;
+}
+
+void loadBorrowers() {
+    TraceSpan span("loadBorrowers");
+    ifstream inFile(BORROWERS_FILE, ios::binary);
+    if (inFile.is_open()) {
+        string content = readWholeFile(inFile);
+        inFile.close();
+        verifyChecksumFile(BORROWERS_FILE, content);
+        borrowersTextStamp = textStampOf(content);
+        istringstream lines(content);
+        loadBorrowerLines(lines, BORROWERS_FILE);
+    } else {
+        libraryNotice("Error opening borrowers file for reading.\n");
+    }
+}
+
+// Files every borrowers.txt line, whether it comes from the file or the shared catalog
+void loadBorrowerLines(istream& in, const string& source) {
+    TraceSpan span("parse borrowers");
+    const char* cacheSetting = getenv(BORROWER_CACHE_ENV.c_str());
+    if (cacheSetting && atol(cacheSetting) > 0 && !borrowerStore.open(BORROWER_STORE_FILE, size_t(atol(cacheSetting)) * 1024)) {
+        libraryNotice("Error creating borrower store. Keeping all borrowers in memory.\n");
+    }
+
+    string line;
+    size_t lineNumber = 0, errors = 0;
+    vector<BorrowedBookDetails> scratch;
+    vector<int> loadedIDs; // Filed into uniqueBorrowerIDs in one pass at the end
+    while (getline(in, line)) {
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+
+        // In memory, loans go straight into the shared loan array; the store only needs them briefly
+        vector<BorrowedBookDetails>& loans = borrowerStore.enabled() ? scratch : loanRecords;
+        scratch.clear();
+        Borrower borrower;
+        if (!parseBorrowerRecord(line, loans, borrower)) {
+            reportLoadError(source, lineNumber, "not a valid borrower record", errors);
+            continue;
+        }
+        watchedBorrowers.image[borrower.id] = recordHash(line);
+
+        // Aggregates and the name index are built as records stream past
+        addLoanStats(borrower, loans.data());
+        appendNameKeys(borrower);
+        loadedIDs.push_back(borrower.id);
+
+        if (borrowerStore.enabled()) {
+            borrowerStore.insert(borrower, scratch.data());
+        } else {
+            borrowers.push_back(borrower);
+        }
+    }
+    reportLoadErrorTotal(source, errors);
+    {
+        TraceSpan ids("build uniqueBorrowerIDs");
+        for (int id : loadedIDs) uniqueBorrowerIDs.insert(id); // Ensure unique IDs
+    }
+    {
+        TraceSpan names("sort name index");
+        sort(borrowerNameIndex.begin(), borrowerNameIndex.end());
+    }
+    borrowerTracker.dirtyFrom = 0;
+}
+
+bool BorrowerStore::open(const string& path, size_t budgetBytes) {
+    file.open(path, ios::in | ios::out | ios::binary | ios::trunc);
+    if (!file.is_open()) return false;
+    budget = budgetBytes;
+    return true;
+}
+
+// Rough heap footprint of a decoded borrower, used to keep the cache within budget
+size_t borrowerBytes(const Borrower& borrower) {
+    size_t bytes = sizeof(BorrowerStore::CacheEntry) + 64; // Hash node and list node overhead
+    bytes += borrower.lastName.capacity() + borrower.firstName.capacity() + borrower.middleInitial.capacity();
+    for (int32_t slot = borrower.overflowHead; slot >= 0; slot = loanOverflow[slot].next) {
+        bytes += sizeof(OverflowLoan);
+    }
+    return bytes;
+}
+
+Borrower BorrowerStore::read(int id, vector<BorrowedBookDetails>& loans) {
+    const Location& location = index.at(id);
+    string line(location.length, '\0');
+    file.seekg(location.offset);
+    file.read(&line[0], location.length);
+    return parseBorrowerLine(line, loans);
+}
+
+// Rewrites in place while the record still fits its slot, otherwise moves it to a new slot at
+// the end of the file. Slots never straddle a page unless the record is larger than one.
+void BorrowerStore::write(int id, const Borrower& borrower, const BorrowedBookDetails* loanBase) {
+    string line = serializeBorrower(borrower, loanBase);
+    auto existing = index.find(id);
+    if (existing == index.end() || line.size() > existing->second.capacity) {
+        uint32_t capacity = uint32_t(line.size() + line.size() / 4 + 16);
+        uint64_t pageUsed = fileEnd % PAGE_SIZE;
+        if (pageUsed != 0 && (capacity > PAGE_SIZE || pageUsed + capacity > PAGE_SIZE)) {
+            fileEnd += PAGE_SIZE - pageUsed;
+        }
+        index[id] = {fileEnd, 0, capacity};
+        fileEnd += capacity;
+    }
+
+    Location& location = index[id];
+    location.length = uint32_t(line.size());
+    file.seekp(location.offset);
+    file.write(line.data(), line.size());
+}
+
+// Rewrites a borrower's record and drops any cached copy, so the next get() decodes the new one
+void BorrowerStore::replace(const Borrower& borrower, const BorrowedBookDetails* loanBase) {
+    uncache(borrower.id);
+    write(borrower.id, borrower, loanBase);
+}
+
+// The record's bytes stay in the scratch file as dead space
+void BorrowerStore::erase(int id) {
+    uncache(id);
+    index.erase(id);
+    order.erase(find(order.begin(), order.end(), id));
+}
+
+// Drops a cached borrower without writing it back
+void BorrowerStore::uncache(int id) {
+    auto cached = cache.find(id);
+    if (cached == cache.end()) return;
+    releaseOverflowLoans(cached->second.borrower);
+    cachedBytes -= cached->second.bytes;
+    lru.erase(cached->second.lruPos);
+    cache.erase(cached);
+}
+
+void BorrowerStore::insert(const Borrower& borrower, const BorrowedBookDetails* loanBase) {
+    write(borrower.id, borrower, loanBase);
+    order.push_back(borrower.id);
+}
+
+Borrower* BorrowerStore::get(int id) {
+    auto cached = cache.find(id);
+    if (cached != cache.end()) {
+        lru.splice(lru.begin(), lru, cached->second.lruPos);
+        return &cached->second.borrower;
+    }
+    if (index.find(id) == index.end()) return nullptr;
+
+    // A cached borrower keeps its loans in the overflow area until it is evicted
+    vector<BorrowedBookDetails> loans;
+    CacheEntry& entry = cache[id];
+    entry.borrower = read(id, loans);
+    entry.borrower.loanBegin = entry.borrower.loanCount = 0;
+    for (const auto& loan : loans) appendLoan(entry.borrower, loan);
+    lru.push_front(id);
+    entry.lruPos = lru.begin();
+    entry.bytes = borrowerBytes(entry.borrower);
+    entry.dirty = false;
+    cachedBytes += entry.bytes;
+    evictOverBudget();
+    return &entry.borrower;
+}
+
+void BorrowerStore::markDirty(int id) {
+    auto cached = cache.find(id);
+    if (cached == cache.end()) return;
+    CacheEntry& entry = cached->second;
+    entry.dirty = true;
+    cachedBytes -= entry.bytes;
+    entry.bytes = borrowerBytes(entry.borrower);
+    cachedBytes += entry.bytes;
+    evictOverBudget();
+}
+
+// Evicts from the cold end, writing dirty borrowers back; the most recent entry always stays
+void BorrowerStore::evictOverBudget() {
+    while (cachedBytes > budget && lru.size() > 1) {
+        int victim = lru.back();
+        CacheEntry& entry = cache[victim];
+        if (entry.dirty) write(victim, entry.borrower);
+        releaseOverflowLoans(entry.borrower);
+        cachedBytes -= entry.bytes;
+        lru.pop_back();
+        cache.erase(victim);
+    }
+}
+
+void BorrowerStore::flush() {
+    for (auto& cached : cache) {
+        if (cached.second.dirty) {
+            write(cached.first, cached.second.borrower);
+            cached.second.dirty = false;
+        }
+    }
+    file.flush();
+}
+
+// Opens books.dat and maps it; a missing or foreign file simply starts empty
+bool BookRecordFile::open(const string& path) {
+#ifdef _WIN32
+    file.open(path, ios::in | ios::out | ios::binary);
+    if (!file.is_open()) {
+        ofstream create(path, ios::binary);
+        create.close();
+        file.open(path, ios::in | ios::out | ios::binary);
+    }
+    if (!file.is_open()) return false;
+    file.seekg(0, ios::end);
+    size_t size = size_t(file.tellg());
+    file.seekg(0);
+    data.assign(size, '\0');
+    if (size > 0) file.read(&data[0], size);
+    file.clear();
+    capacity = size < HEADER_SIZE ? 0 : (size - HEADER_SIZE) / sizeof(BookRecord);
+#else
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0) return false;
+    capacity = size_t(info.st_size) < HEADER_SIZE ? 0 : (size_t(info.st_size) - HEADER_SIZE) / sizeof(BookRecord);
+    if (!map()) return false;
+#endif
+    count = 0;
+    if (capacity > 0 && memcmp(header(), MAGIC, sizeof(MAGIC)) == 0) {
+        memcpy(&count, header() + sizeof(MAGIC), sizeof(count));
+        count = min<uint32_t>(count, uint32_t(capacity));
+    }
+    return true;
+}
+
+// Rewrites the whole file from the catalog, giving every live book its own record
+void BookRecordFile::rebuild() {
+    size_t live = 0;
+    for (auto category : categoryLists) live += category->size();
+    if (!reserve(max<size_t>(live, 64))) return;
+
+    count = 0;
+    for (uint8_t c = 0; c < 10; ++c) {
+        for (const auto& handle : categoryLists[c]->handles) {
+            BookSlot& entry = bookSlab[handle.slot];
+            entry.record = int32_t(count++);
+            fill(entry);
+        }
+    }
+    memcpy(header(), MAGIC, sizeof(MAGIC));
+    memcpy(header() + sizeof(MAGIC), &count, sizeof(count));
+    sync(0, HEADER_SIZE + count * sizeof(BookRecord));
+}
+
+// Full record, appending one for a book that has none yet
+void BookRecordFile::store(BookSlot& entry) {
+    if (!enabled()) return;
+    if (entry.record < 0) {
+        if (!reserve(count + 1)) return;
+        entry.record = int32_t(count++);
+        memcpy(header() + sizeof(MAGIC), &count, sizeof(count));
+        sync(0, HEADER_SIZE);
+    }
+    fill(entry);
+    sync(offsetOf(entry.record), sizeof(BookRecord));
+}
+
+// The borrow/return path: four bytes written, one page flushed (or left for commit())
+void BookRecordFile::storeCopies(const BookSlot& entry, bool flush) {
+    if (!enabled() || entry.record < 0) return;
+    size_t offset = offsetOf(entry.record) + offsetof(BookRecord, copies);
+    int32_t copies = entry.book.copies;
+    memcpy(bytes() + offset, &copies, sizeof(copies));
+    if (flush) {
+        sync(offset, sizeof(copies));
+    } else {
+        pendingBegin = min(pendingBegin, offset);
+        pendingEnd = max(pendingEnd, offset + sizeof(copies));
+    }
+}
+
+// Flushes every deferred write at once
+void BookRecordFile::commit() {
+    if (pendingEnd > pendingBegin) sync(pendingBegin, pendingEnd - pendingBegin);
+    pendingBegin = SIZE_MAX;
+    pendingEnd = 0;
+}
+
+void BookRecordFile::remove(BookSlot& entry) {
+    if (!enabled() || entry.record < 0) return;
+    size_t offset = offsetOf(entry.record);
+    memset(bytes() + offset, 0, sizeof(BookRecord)); // id 0 marks a free record
+    sync(offset, sizeof(BookRecord));
+    entry.record = -1;
+}
+
+TextStamp BookRecordFile::textStamp() const {
+    TextStamp stamp;
+    if (!enabled()) return stamp;
+    memcpy(&stamp.length, header() + STAMP_OFFSET, sizeof(stamp.length));
+    memcpy(&stamp.crc, header() + STAMP_OFFSET + sizeof(stamp.length), sizeof(stamp.crc));
+    return stamp;
+}
+
+void BookRecordFile::setTextStamp(const TextStamp& stamp) {
+    if (!enabled()) return;
+    memcpy(header() + STAMP_OFFSET, &stamp.length, sizeof(stamp.length));
+    memcpy(header() + STAMP_OFFSET + sizeof(stamp.length), &stamp.crc, sizeof(stamp.crc));
+    sync(0, HEADER_SIZE);
+}
+
+void BookRecordFile::fill(const BookSlot& entry) {
+    BookRecord record = {};
+    record.id = entry.book.id;
+    record.copies = entry.book.copies;
+    record.category = entry.category;
+    record.titleLength = uint8_t(min(entry.book.title.size(), sizeof(record.title)));
+    memcpy(record.title, entry.book.title.data(), record.titleLength);
+    memcpy(bytes() + offsetOf(entry.record), &record, sizeof(record));
+}
+
+BookRecord BookRecordFile::recordAt(uint32_t index) const {
+    BookRecord record;
+    memcpy(&record, bytes() + offsetOf(index), sizeof(record));
+    return record;
+}
+
+// Grows the file (doubling) so appends rarely remap
+bool BookRecordFile::reserve(size_t records) {
+    if (records <= capacity) return true;
+    size_t grown = max(records, capacity * 2);
+#ifdef _WIN32
+    data.resize(HEADER_SIZE + grown * sizeof(BookRecord), '\0');
+    capacity = grown;
+    sync(0, data.size());
+    return true;
+#else
+    if (mapped) munmap(mapped, mappedSize);
+    mapped = nullptr;
+    if (ftruncate(fd, off_t(HEADER_SIZE + grown * sizeof(BookRecord))) != 0) return false;
+    capacity = grown;
+    return map();
+#endif
+}
+
+#ifdef _WIN32
+char* BookRecordFile::bytes() const { return const_cast<char*>(data.data()); }
+
+// No mmap here: write the touched bytes straight through the stream instead
+void BookRecordFile::sync(size_t offset, size_t length) {
+    file.seekp(streamoff(offset));
+    file.write(data.data() + offset, streamsize(length));
+    file.flush();
+}
+#else
+char* BookRecordFile::bytes() const { return mapped; }
+
+bool BookRecordFile::map() {
+    mappedSize = HEADER_SIZE + capacity * sizeof(BookRecord);
+    if (capacity == 0) return true;
+    void* address = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+        mappedSize = 0;
+        return false;
+    }
+    mapped = static_cast<char*>(address);
+    return true;
+}
+
+// msync wants a page-aligned start, so flush from the page holding the first touched byte
+void BookRecordFile::sync(size_t offset, size_t length) {
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    size_t start = offset / page * page;
+    msync(mapped + start, offset + length - start, MS_SYNC);
+}
+#endif
+
+// books.dat is updated on every borrow and return, so its copy counts win over the books.txt they
+// follow. A books.txt edited since, or saved after books.dat was last stamped, wins instead.
+// Returns true when the copy counts came from books.dat.
+bool loadBookRecords() {
+    TraceSpan span("loadBookRecords");
+    if (!bookRecords.open(BOOK_RECORDS_FILE)) {
+        libraryNotice("Error opening book record file; copy counts will only be saved on exit.\n");
+        return false;
+    }
+    bool current = bookRecords.count > 0 && bookRecords.textStamp() == booksTextStamp;
+    if (current) {
+        for (uint32_t i = 0; i < bookRecords.count; ++i) {
+            BookRecord record = bookRecords.recordAt(i);
+            if (record.id == 0) continue;
+            Book* book = resolveBook(findBookHandle(record.id));
+            if (book) book->copies = record.copies;
+        }
+    } else if (bookRecords.count > 0) {
+        libraryNotice(BOOK_RECORDS_FILE + " was written for a different " + BOOKS_FILE + "; the copy counts in " + BOOKS_FILE + " were used.\n");
+    }
+    bookRecords.rebuild();
+    bookRecords.setTextStamp(booksTextStamp);
+    return current;
+}
+
+TextStamp textStampOf(const string& text) {
+    TextStamp stamp;
+    stamp.length = text.size();
+    stamp.crc = crc32c(text.data(), text.size());
+    return stamp;
+}
+
+#ifdef _WIN32
+bool LoanJournal::enabled() const { return file.is_open(); }
+
+bool LoanJournal::open(const string& journalPath) {
+    path = journalPath;
+    file.open(path, ios::binary | ios::app);
+    return file.is_open();
+}
+
+void LoanJournal::restart(const TextStamp& borrowersStamp) {
+    if (!enabled()) return;
+    file.close();
+    file.open(path, ios::binary | ios::trunc);
+    file << "loans " << borrowersStamp.length << " " << hex << borrowersStamp.crc << dec << "\n";
+    file.flush();
+    pending.clear();
+}
+
+void LoanJournal::commit() {
+    if (!enabled() || pending.empty()) return;
+    file << pending;
+    file.flush();
+    pending.clear();
+}
+#else
+bool LoanJournal::enabled() const { return fd >= 0; }
+
+bool LoanJournal::open(const string& path) {
+    fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    return fd >= 0;
+}
+
+void LoanJournal::restart(const TextStamp& borrowersStamp) {
+    if (!enabled()) return;
+    ostringstream header;
+    header << "loans " << borrowersStamp.length << " " << hex << borrowersStamp.crc << "\n";
+    pending = header.str();
+    if (ftruncate(fd, 0) != 0) libraryNotice("Error clearing " + LOAN_JOURNAL_FILE + ".\n");
+    commit();
+}
+
+// Appended and synced before books.dat is flushed, so books.dat never counts a loan the journal lacks
+void LoanJournal::commit() {
+    if (!enabled() || pending.empty()) return;
+    size_t written = 0;
+    while (written < pending.size()) {
+        ssize_t result = ::write(fd, pending.data() + written, pending.size() - written);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) {
+            libraryNotice("Error writing " + LOAN_JOURNAL_FILE + "; the latest loans will only be saved on exit.\n");
+            break;
+        }
+        written += size_t(result);
+    }
+    fdatasync(fd);
+    pending.clear();
+}
+#endif
+
+void LoanJournal::noteBorrow(int borrowerID, const string& date, const vector<int>& bookIDs) {
+    if (!enabled()) return;
+    pending += "B," + to_string(borrowerID) + "," + date;
+    for (int id : bookIDs) pending += "," + to_string(id);
+    pending += "\n";
+}
+
+// Fees are kept as charged, since the fee rule may change before the journal is replayed
+void LoanJournal::noteReturn(int borrowerID, const string& date, const vector<int>& bookIDs, const vector<int>& fees) {
+    if (!enabled()) return;
+    pending += "R," + to_string(borrowerID) + "," + date;
+    for (size_t i = 0; i < bookIDs.size(); ++i) pending += "," + to_string(bookIDs[i]) + ":" + to_string(fees[i]);
+    pending += "\n";
+}
+
+// Re-applies the loans of a run that stopped before saving, then keeps journaling after them.
+// When books.dat was trusted its copy counts already include these loans; otherwise the copies
+// are taken and restocked here. A journal that follows another borrowers.txt is dropped.
+void replayLoanJournal(bool adjustCopies) {
+    TraceSpan span("replayLoanJournal");
+    bool current = false;
+    size_t replayed = 0, skipped = 0;
+    string kept; // Replayed lines, written back when the journal has to start over
+    ifstream inFile(LOAN_JOURNAL_FILE, ios::binary);
+    string line;
+    if (inFile.is_open() && getline(inFile, line)) {
+        string format;
+        TextStamp follows;
+        istringstream fields(line);
+        fields >> format >> follows.length >> hex >> follows.crc;
+        current = fields && format == "loans" && follows == borrowersTextStamp;
+        while (getline(inFile, line)) {
+            if (line.empty()) continue;
+            if (current && replayLoanLine(line, adjustCopies)) {
+                replayed++;
+                kept += line + "\n";
+            } else {
+                skipped++;
+            }
+        }
+    }
+    inFile.close();
+
+    if (replayed > 0) {
+        commitTransaction();
+        libraryNotice("Recovered " + to_string(replayed) + " loan transactions from " + LOAN_JOURNAL_FILE + " that were not saved before the program last stopped.\n");
+    }
+    if (skipped > 0) {
+        libraryNotice(to_string(skipped) + " loan transactions in " + LOAN_JOURNAL_FILE + (current ? " could not be applied" : " follow a different " + BORROWERS_FILE) +
+                      " and were dropped.\n");
+    }
+    if (!loanJournal.open(LOAN_JOURNAL_FILE)) {
+        libraryNotice("Error opening " + LOAN_JOURNAL_FILE + "; loans will only be saved on exit.\n");
+    } else if (!current || skipped > 0) {
+        loanJournal.restart(borrowersTextStamp);
+        loanJournal.pending = kept;
+        loanJournal.commit();
+    }
+}
+
+BookSlot* findBookSlot(const Book& book) {
+    BookHandle handle = findBookHandle(book.id);
+    return resolveBook(handle) == &book ? &bookSlab[handle.slot] : nullptr;
+}
+
+// Fold one borrower's history in while loading; afterwards the stats are kept current by recordBorrow()/recordReturn()
+void addLoanStats(const Borrower& borrower, const BorrowedBookDetails* loanBase) {
+    coBorrowDirty = true;
+    BorrowerStats& stats = borrowerStats[borrower.id];
+    for (const auto& loan : loansOf(borrower, loanBase)) {
+        BookStats& book = bookStats[loan.id];
+        book.timesBorrowed++;
+        if (loan.returnDay == NOT_RETURNED) {
+            stats.activeLoans++;
+            book.currentlyOut++;
+            scheduleDue(borrower.id, loan.id, loan.borrowDay);
+        }
+        indexLoanInterval(borrower.id, loan.id, loan.borrowDay, loan.returnDay == NOT_RETURNED ? OPEN_INTERVAL : loan.returnDay);
+        stats.lifetimeFees += loan.overdueFee;
+    }
+}
+
+// Undoes addLoanStats() for a borrower about to be replaced or removed
+void dropLoanStats(const Borrower& borrower, const BorrowedBookDetails* loanBase) {
+    coBorrowDirty = true;
+    BorrowerStats& stats = borrowerStats[borrower.id];
+    for (const auto& loan : loansOf(borrower, loanBase)) {
+        BookStats& book = bookStats[loan.id];
+        book.timesBorrowed--;
+        if (loan.returnDay == NOT_RETURNED) {
+            stats.activeLoans--;
+            book.currentlyOut--;
+            cancelDue(borrower.id, loan.id, loan.borrowDay);
+        }
+        unindexLoanInterval(borrower.id, loan.id, loan.borrowDay, loan.returnDay == NOT_RETURNED ? OPEN_INTERVAL : loan.returnDay);
+        stats.lifetimeFees -= loan.overdueFee;
+    }
+}
+
+// Called once the loan is appended and the copy taken; publishes the new version unless a
+// batch transaction will commit everything together
+void recordBorrow(Borrower& borrower, Book& book, const string& borrowDate, bool commit) {
+    borrowerStats[borrower.id].activeLoans++;
+    BookStats& stats = bookStats[book.id];
+    stats.timesBorrowed++;
+    stats.currentlyOut++;
+    scheduleDue(borrower.id, book.id, daysFromDate(borrowDate));
+    indexLoanInterval(borrower.id, book.id, daysFromDate(borrowDate), OPEN_INTERVAL);
+    noteCoBorrow(borrower, book.id);
+    emitLoanChange(CHANGE_BORROW, borrower.id, book.id, daysFromDate(borrowDate), NOT_RETURNED, 0);
+    markBorrowerChanged(borrower);
+    markBookChanged(book);
+    if (BookSlot* entry = findBookSlot(book)) bookRecords.storeCopies(*entry, commit);
+    if (commit) publishSnapshot();
+}
+
+// Called once the loan is closed; the caller publishes after restocking the copy
+void recordReturn(Borrower& borrower, int bookID, int borrowDay, int returnDay, int overdueFee) {
+    BorrowerStats& stats = borrowerStats[borrower.id];
+    stats.activeLoans = max(0, stats.activeLoans - 1);
+    stats.lifetimeFees += overdueFee;
+    BookStats& book = bookStats[bookID];
+    book.currentlyOut = max(0, book.currentlyOut - 1);
+    cancelDue(borrower.id, bookID, borrowDay);
+    closeLoanInterval(borrower.id, bookID, borrowDay, returnDay);
+    emitLoanChange(CHANGE_RETURN, borrower.id, bookID, borrowDay, returnDay, overdueFee);
+    markBorrowerChanged(borrower);
+}
+
+void markBookChanged(const Book& book) {
+    noteSharedChange(SHARED_BOOK, book.id);
+    BookHandle handle = findBookHandle(book.id);
+    if (resolveBook(handle) != &book) return;
+    const BookSlot& entry = bookSlab[handle.slot];
+    categoryTrackers[entry.category].dirtyChunks.insert(entry.position / SNAPSHOT_CHUNK);
+    bumpCategoryVersion(entry.category);
+    reindexBook(handle.slot);
+}
+
+// Erasing shifts every later handle, so all later chunks change
+void markBookRemoved(const BookList& books, size_t index) {
+    categoryTrackers[books.category].dirtyFrom = min(categoryTrackers[books.category].dirtyFrom, index / SNAPSHOT_CHUNK);
+}
+
+// Titles sort case-insensitively everywhere: the maintained orders and catalog queries alike
+string titleSortKey(const string& title) {
+    return lowercase(title);
+}
+
+bool titleBefore(uint32_t a, uint32_t b) {
+    const BookSlot& x = bookSlab[a];
+    const BookSlot& y = bookSlab[b];
+    if (x.titleKey != y.titleKey) return x.titleKey < y.titleKey;
+    return x.book.id < y.book.id;
+}
+
+bool idBefore(uint32_t a, uint32_t b) {
+    if (bookSlab[a].book.id != bookSlab[b].book.id) return bookSlab[a].book.id < bookSlab[b].book.id;
+    return a < b;
+}
+
+bool copiesBefore(uint32_t a, uint32_t b) {
+    const BookSlot& x = bookSlab[a];
+    const BookSlot& y = bookSlab[b];
+    if (x.copiesKey != y.copiesKey) return x.copiesKey < y.copiesKey;
+    return x.book.id < y.book.id;
+}
+
+void insertSorted(vector<uint32_t>& order, uint32_t slot, bool (*before)(uint32_t, uint32_t)) {
+    order.insert(lower_bound(order.begin(), order.end(), slot, before), slot);
+}
+
+// Found by the keys the slot was filed under, which is why those keys are kept in the slot
+void eraseSorted(vector<uint32_t>& order, uint32_t slot, bool (*before)(uint32_t, uint32_t)) {
+    auto it = lower_bound(order.begin(), order.end(), slot, before);
+    if (it != order.end() && *it == slot) order.erase(it);
+}
+
+void linkSortOrders(uint32_t slot) {
+    BookSlot& entry = bookSlab[slot];
+    entry.titleKey = titleSortKey(entry.book.title);
+    entry.copiesKey = entry.book.copies;
+    SortOrders* owners[2] = {&categorySortOrders[entry.category], &catalogSortOrders};
+    for (SortOrders* orders : owners) {
+        insertSorted(orders->byTitle, slot, titleBefore);
+        insertSorted(orders->byID, slot, idBefore);
+        insertSorted(orders->byCopies, slot, copiesBefore);
+    }
+}
+
+void unlinkSortOrders(uint32_t slot) {
+    const BookSlot& entry = bookSlab[slot];
+    SortOrders* owners[2] = {&categorySortOrders[entry.category], &catalogSortOrders};
+    for (SortOrders* orders : owners) {
+        eraseSorted(orders->byTitle, slot, titleBefore);
+        eraseSorted(orders->byID, slot, idBefore);
+        eraseSorted(orders->byCopies, slot, copiesBefore);
+    }
+}
+
+// Moves the book only within the orders whose key actually changed
+void reindexBook(uint32_t slot) {
+    BookSlot& entry = bookSlab[slot];
+    string title = titleSortKey(entry.book.title);
+    bool titleChanged = title != entry.titleKey;
+    bool copiesChanged = entry.copiesKey != entry.book.copies;
+    if (!titleChanged && !copiesChanged) return;
+    if (titleChanged) bumpTitleVersion();
+
+    SortOrders* owners[2] = {&categorySortOrders[entry.category], &catalogSortOrders};
+    for (SortOrders* orders : owners) {
+        if (titleChanged) eraseSorted(orders->byTitle, slot, titleBefore);
+        if (copiesChanged) eraseSorted(orders->byCopies, slot, copiesBefore);
+    }
+    entry.titleKey = title;
+    entry.copiesKey = entry.book.copies;
+    for (SortOrders* orders : owners) {
+        if (titleChanged) insertSorted(orders->byTitle, slot, titleBefore);
+        if (copiesChanged) insertSorted(orders->byCopies, slot, copiesBefore);
+    }
+}
+
+// Loading files every book unsorted and sorts once here; later changes go through link/unlink/reindex
+void rebuildSortOrders() {
+    TraceSpan span("rebuildSortOrders");
+    catalogSortOrders = SortOrders();
+    for (uint8_t c = 0; c < 10; ++c) {
+        SortOrders& orders = categorySortOrders[c];
+        orders = SortOrders();
+        for (const auto& handle : categoryLists[c]->handles) {
+            BookSlot& entry = bookSlab[handle.slot];
+            entry.titleKey = titleSortKey(entry.book.title);
+            entry.copiesKey = entry.book.copies;
+            orders.byTitle.push_back(handle.slot);
+        }
+        sort(orders.byTitle.begin(), orders.byTitle.end(), titleBefore);
+        orders.byID = orders.byCopies = orders.byTitle;
+        sort(orders.byID.begin(), orders.byID.end(), idBefore);
+        sort(orders.byCopies.begin(), orders.byCopies.end(), copiesBefore);
+
+        catalogSortOrders.byTitle.insert(catalogSortOrders.byTitle.end(), orders.byTitle.begin(), orders.byTitle.end());
+    }
+    catalogSortOrders.byID = catalogSortOrders.byCopies = catalogSortOrders.byTitle;
+    sort(catalogSortOrders.byTitle.begin(), catalogSortOrders.byTitle.end(), titleBefore);
+    sort(catalogSortOrders.byID.begin(), catalogSortOrders.byID.end(), idBefore);
+    sort(catalogSortOrders.byCopies.begin(), catalogSortOrders.byCopies.end(), copiesBefore);
+}
+
+// Rows [first, first + count) of an order, copied out for display
+vector<Book> sortedPage(const vector<uint32_t>& order, size_t first, size_t count) {
+    vector<Book> page;
+    for (size_t i = first; i < order.size() && i < first + count; ++i) {
+        page.push_back(bookSlab[order[i]].book);
+    }
+    return page;
+}
+
+void markBorrowerChanged(const Borrower& borrower) {
+    noteSharedChange(SHARED_BORROWER, borrower.id);
+    bumpBorrowerVersion(borrower.id);
+    if (borrowerStore.enabled()) {
+        borrowerStore.markDirty(borrower.id); // Written back on eviction or save
+        return;
+    }
+    borrowerTracker.dirtyChunks.insert(size_t(&borrower - borrowers.data()) / SNAPSHOT_CHUNK);
+}
+
+// Render versions: any change to what a cached view shows moves its version on, so the
+// view is rendered again the next time it is displayed
+void bumpCategoryVersion(uint8_t category) {
+    categoryVersions[category] = ++renderVersionClock;
+}
+
+void bumpBorrowerVersion(int borrowerID) {
+    borrowerVersions[borrowerID] = ++renderVersionClock;
+}
+
+void bumpTitleVersion() {
+    titleVersion = ++renderVersionClock;
+}
+
+uint64_t borrowerVersion(int borrowerID) {
+    auto found = borrowerVersions.find(borrowerID);
+    return found == borrowerVersions.end() ? 0 : found->second;
+}
+
+// Rebuild only the chunks that changed (or grew); the rest are shared with the previous version
+template <typename Chunk, typename Build>
+void refreshChunks(vector<shared_ptr<const Chunk>>& chunks, size_t liveSize, SnapshotTracker& tracker, Build build) {
+    size_t chunkCount = (liveSize + SNAPSHOT_CHUNK - 1) / SNAPSHOT_CHUNK;
+    size_t reused = chunks.size();
+    chunks.resize(chunkCount);
+    for (size_t c = 0; c < chunkCount; ++c) {
+        size_t begin = c * SNAPSHOT_CHUNK;
+        size_t end = min(liveSize, begin + SNAPSHOT_CHUNK);
+        bool changed = c >= reused || c >= tracker.dirtyFrom || tracker.dirtyChunks.count(c) || chunks[c]->size() != end - begin;
+        if (changed) {
+            chunks[c] = build(begin, end);
+        }
+    }
+    tracker = SnapshotTracker();
+}
+
+// Borrower chunks carry their own copy of the loans, so later returns never show through
+shared_ptr<const BorrowerChunk> buildBorrowerChunk(size_t begin, size_t end) {
+    shared_ptr<BorrowerChunk> chunk = make_shared<BorrowerChunk>();
+    chunk->borrowers.assign(borrowers.begin() + begin, borrowers.begin() + end);
+    for (auto& borrower : chunk->borrowers) {
+        chunk->versions.push_back(borrowerVersion(borrower.id));
+        uint32_t loanBegin = uint32_t(chunk->loans.size());
+        for (const auto& loan : loansOf(borrower)) chunk->loans.push_back(loan);
+        borrower.loanBegin = loanBegin;
+        borrower.loanCount = uint32_t(chunk->loans.size() - loanBegin);
+        borrower.overflowHead = borrower.overflowTail = -1;
+    }
+    return chunk;
+}
+
+// Writers call this after mutating the live vectors; the swap is atomic, so readers see either
+// the old or the new version. A version is freed when the last reader holding it lets go.
+void publishSnapshot() {
+    TraceSpan span("publishSnapshot");
+    shareChanges();
+    lock_guard<mutex> lock(snapshotWriteMutex);
+    shared_ptr<LibrarySnapshot> next = make_shared<LibrarySnapshot>(*atomic_load(&currentSnapshot));
+    next->version++;
+    for (size_t c = 0; c < 10; ++c) {
+        const BookList& books = *categoryLists[c];
+        refreshChunks(next->categoryChunks[c], books.size(), categoryTrackers[c], [&](size_t begin, size_t end) {
+            return make_shared<const vector<Book>>(books.begin() + begin, books.begin() + end);
+        });
+    }
+    next->categoryVersions = categoryVersions;
+    refreshChunks(next->borrowerChunks, borrowers.size(), borrowerTracker, buildBorrowerChunk);
+    atomic_store(&currentSnapshot, shared_ptr<const LibrarySnapshot>(next));
+}
+
+// Readers keep the returned pointer for as long as they need a stable view
+shared_ptr<const LibrarySnapshot> pinSnapshot() {
+    return atomic_load(&currentSnapshot);
+}
+
+// The due-date wheel keeps one bucket per due day, so a day's overdue list costs only the loans in it.
+// The due day comes from the book's category when the loan is scheduled and is remembered, so
+// a book deleted or refiled while on loan is still found in the bucket it went into.
+void scheduleDue(int borrowerID, int bookID, int borrowDay) {
+    int dueDay = borrowDay + feeRuleFor(findBookHandle(bookID)).loanDays;
+    dueWheel[dueDay].push_back({borrowerID, bookID, borrowDay, dueDay});
+    scheduledDueDays.insert({make_tuple(borrowerID, bookID, borrowDay), dueDay});
+}
+
+void cancelDue(int borrowerID, int bookID, int borrowDay) {
+    auto scheduled = scheduledDueDays.find(make_tuple(borrowerID, bookID, borrowDay));
+    if (scheduled == scheduledDueDays.end()) return;
+    auto bucket = dueWheel.find(scheduled->second);
+    scheduledDueDays.erase(scheduled);
+    if (bucket == dueWheel.end()) return;
+
+    vector<DueEntry>& entries = bucket->second;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].borrowerID == borrowerID && entries[i].bookID == bookID && entries[i].borrowDay == borrowDay) {
+            entries[i] = entries.back();
+            entries.pop_back();
+            break;
+        }
+    }
+    if (entries.empty()) dueWheel.erase(bucket);
+}
+
+// Loans whose last allowed day is the given day, i.e. the ones that turn overdue the day after
+vector<DueEntry> loansDueOn(int day) {
+    auto bucket = dueWheel.find(day);
+    return bucket == dueWheel.end() ? vector<DueEntry>() : bucket->second;
+}
+
+// Loans are filed by the week they were borrowed in; each bucket tracks its latest end day
+// so overlap queries skip weeks whose loans all ended before the range starts
+void indexLoanInterval(int borrowerID, int bookID, int borrowDay, int endDay) {
+    int week = borrowDay / INTERVAL_BUCKET_DAYS;
+    IntervalBucket& bucket = loanIntervals[week];
+    bucket.loans.push_back({borrowDay, endDay, borrowerID, bookID});
+    bucket.maxEnd = max(bucket.maxEnd, endDay);
+    if (endDay == OPEN_INTERVAL) {
+        bucket.openLoans++;
+        openIntervalBuckets.insert(week);
+    } else {
+        longestClosedLoan = max(longestClosedLoan, endDay - borrowDay);
+    }
+}
+
+void closeLoanInterval(int borrowerID, int bookID, int borrowDay, int returnDay) {
+    auto found = loanIntervals.find(borrowDay / INTERVAL_BUCKET_DAYS);
+    if (found == loanIntervals.end()) return;
+
+    IntervalBucket& bucket = found->second;
+    for (auto& loan : bucket.loans) {
+        if (loan.borrowerID == borrowerID && loan.bookID == bookID && loan.borrowDay == borrowDay && loan.endDay == OPEN_INTERVAL) {
+            loan.endDay = returnDay;
+            longestClosedLoan = max(longestClosedLoan, returnDay - borrowDay);
+            if (--bucket.openLoans == 0) openIntervalBuckets.erase(found->first);
+            break;
+        }
+    }
+    bucket.maxEnd = INT32_MIN;
+    for (const auto& loan : bucket.loans) bucket.maxEnd = max(bucket.maxEnd, loan.endDay);
+}
+
+void unindexLoanInterval(int borrowerID, int bookID, int borrowDay, int endDay) {
+    auto found = loanIntervals.find(borrowDay / INTERVAL_BUCKET_DAYS);
+    if (found == loanIntervals.end()) return;
+
+    IntervalBucket& bucket = found->second;
+    for (auto loan = bucket.loans.begin(); loan != bucket.loans.end(); ++loan) {
+        if (loan->borrowerID == borrowerID && loan->bookID == bookID && loan->borrowDay == borrowDay && loan->endDay == endDay) {
+            bucket.loans.erase(loan);
+            if (endDay == OPEN_INTERVAL && --bucket.openLoans == 0) openIntervalBuckets.erase(found->first);
+            break;
+        }
+    }
+    if (bucket.loans.empty()) {
+        loanIntervals.erase(found);
+        return;
+    }
+    bucket.maxEnd = INT32_MIN;
+    for (const auto& loan : bucket.loans) bucket.maxEnd = max(bucket.maxEnd, loan.endDay);
+}
+
+// Loans borrowed on a day in [firstDay, lastDay]
+vector<LoanInterval> loansBorrowedBetween(int firstDay, int lastDay) {
+    vector<LoanInterval> matches;
+    auto end = loanIntervals.upper_bound(lastDay / INTERVAL_BUCKET_DAYS);
+    for (auto bucket = loanIntervals.lower_bound(firstDay / INTERVAL_BUCKET_DAYS); bucket != end; ++bucket) {
+        for (const auto& loan : bucket->second.loans) {
+            if (loan.borrowDay >= firstDay && loan.borrowDay <= lastDay) matches.push_back(loan);
+        }
+    }
+    sort(matches.begin(), matches.end());
+    return matches;
+}
+
+// Loans that were out on at least one day in [firstDay, lastDay]. A returned loan borrowed
+// more than longestClosedLoan days before the range cannot reach it, so the scan starts at
+// that week; older weeks are only visited for their loans still out, which all match.
+vector<LoanInterval> loansOutDuring(int firstDay, int lastDay) {
+    vector<LoanInterval> matches;
+    int earliest = firstDay - longestClosedLoan;
+    int firstWeek = earliest < 0 ? -1 : earliest / INTERVAL_BUCKET_DAYS;
+    for (auto week = openIntervalBuckets.begin(); week != openIntervalBuckets.end() && *week < firstWeek; ++week) {
+        for (const auto& loan : loanIntervals[*week].loans) {
+            if (loan.endDay == OPEN_INTERVAL && loan.borrowDay <= lastDay) matches.push_back(loan);
+        }
+    }
+
+    auto end = loanIntervals.upper_bound(lastDay / INTERVAL_BUCKET_DAYS);
+    for (auto bucket = loanIntervals.lower_bound(firstWeek); bucket != end; ++bucket) {
+        if (bucket->second.maxEnd < firstDay) continue;
+        for (const auto& loan : bucket->second.loans) {
+            if (loan.borrowDay <= lastDay && loan.endDay >= firstDay) matches.push_back(loan);
+        }
+    }
+    sort(matches.begin(), matches.end());
+    return matches;
+}
+
+FileStamp stampOf(const string& path) {
+    FileStamp stamp;
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return stamp;
+    stamp.size = int64_t(info.st_size);
+    stamp.inode = int64_t(info.st_ino);
+#ifdef __linux__
+    stamp.modified = int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#else
+    stamp.modified = int64_t(info.st_mtime);
+#endif
+    return stamp;
+}
+
+// books.txt lines are "Category,ID,Title,Copies"; borrowers.txt lines start with the ID
+int bookLineID(const string& line) {
+    size_t comma = line.find(',');
+    return comma == string::npos ? 0 : atoi(line.c_str() + comma + 1);
+}
+
+int borrowerLineID(const string& line) {
+    return atoi(line.c_str());
+}
+
+// 64-bit FNV-1a. The watcher keeps only this per record, so watching borrowers.txt costs a few
+// bytes a borrower rather than a copy of the file, which would defeat the disk store's budget.
+uint64_t recordHash(const string& line) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : line) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Bracket every save of a watched file, so the watcher takes the new version as its own
+void beginSelfWrite(WatchedFile& file) {
+    lock_guard<mutex> lock(reloadMutex);
+    file.writing = true;
+}
+
+void endSelfWrite(WatchedFile& file) {
+    lock_guard<mutex> lock(reloadMutex);
+    file.writing = false;
+    file.written = stampOf(file.path);
+}
+
+// Watcher thread: reads a changed file, diffs it against the image and queues the difference
+void readWatchedFile(WatchedFile& file) {
+    bool ownWrite;
+    {
+        lock_guard<mutex> lock(reloadMutex);
+        if (file.writing) return; // Still saving; looked at again next tick
+        file.changed = false;
+        ownWrite = stampOf(file.path) == file.written;
+    }
+
+    ifstream inFile(file.path, ios::binary);
+    if (!inFile.is_open()) return; // Mid-rename; the rename raises its own event
+    string content = readWholeFile(inFile);
+    inFile.close();
+
+    // Records whose hash differs from the image are taken with their text; when we wrote the
+    // file ourselves memory already matches it, so only the new hashes are kept
+    unordered_map<int, uint64_t> next;
+    vector<pair<int, string>> upserts;
+    istringstream lines(content);
+    string line;
+    while (getline(lines, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        int id = file.recordID(line);
+        if (id <= 0) continue;
+        uint64_t hash = recordHash(line);
+        next[id] = hash;
+        if (ownWrite) continue;
+        auto old = file.image.find(id);
+        if (old == file.image.end() || old->second != hash) upserts.push_back({id, line});
+    }
+
+    if (ownWrite) {
+        file.image.swap(next);
+        return;
+    }
+
+    vector<int> removals;
+    for (const auto& record : file.image) {
+        if (!next.count(record.first)) removals.push_back(record.first);
+    }
+    file.image.swap(next);
+    if (upserts.empty() && removals.empty()) return;
+
+    // A later change to the same record replaces whatever is still queued for it
+    lock_guard<mutex> lock(reloadMutex);
+    for (auto& record : upserts) {
+        file.removals.erase(record.first);
+        file.upserts[record.first] = move(record.second);
+    }
+    for (int id : removals) {
+        file.upserts.erase(id);
+        file.removals.insert(id);
+    }
+}
+
+// inotify on the working directory catches both in-place rewrites and imports that rename a
+// finished file over the old one; returns -1 where inotify is unavailable
+int openFileEvents() {
+#ifdef __linux__
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd >= 0 && inotify_add_watch(fd, ".", IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+void waitForFileEvents(int fd, WatchedFile* const files[], size_t fileCount) {
+#ifdef __linux__
+    pollfd request = {fd, POLLIN, 0};
+    if (poll(&request, 1, WATCH_INTERVAL_MS) <= 0) return;
+
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char* at = buffer; at < buffer + length; ) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(at);
+            for (size_t i = 0; i < fileCount; ++i) {
+                if (event->len > 0 && files[i]->path == event->name) files[i]->changed = true;
+            }
+            at += sizeof(inotify_event) + event->len;
+        }
+    }
+#endif
+}
+
+// Fallback without inotify: compare each file's stamp every interval
+void pollFileStamps(WatchedFile* const files[], size_t fileCount) {
+    this_thread::sleep_for(chrono::milliseconds(WATCH_INTERVAL_MS));
+    for (size_t i = 0; i < fileCount; ++i) {
+        FileStamp stamp = stampOf(files[i]->path);
+        if (!(stamp == files[i]->seen)) {
+            files[i]->seen = stamp;
+            files[i]->changed = true;
+        }
+    }
+}
+
+void watchDataFiles() {
+    nameTraceThread("file watcher");
+    WatchedFile* const files[] = {&watchedBooks, &watchedBorrowers};
+    int fd = openFileEvents();
+    for (auto* file : files) file->seen = stampOf(file->path);
+
+    while (!watcherStopping) {
+        if (fd >= 0) waitForFileEvents(fd, files, 2);
+        else pollFileStamps(files, 2);
+        for (auto* file : files) {
+            if (file->changed) readWatchedFile(*file);
+        }
+    }
+#ifdef __linux__
+    if (fd >= 0) close(fd);
+#endif
+}
+
+void startFileWatcher() {
+    watcherStopping = false;
+    fileWatcher = thread(watchDataFiles);
+}
+
+void stopFileWatcher() {
+    watcherStopping = true;
+    if (fileWatcher.joinable()) fileWatcher.join();
+}
+
+// Removes a book from its list and every index, as deleting it from the Search Menu does
+void removeBook(BookHandle handle) {
+    BookSlot& entry = bookSlab[handle.slot];
+    BookList& books = *categoryLists[entry.category];
+    size_t index = entry.position;
+    noteSharedChange(SHARED_BOOK, entry.book.id);
+    emitBookChange(CHANGE_BOOK_REMOVED, entry.book);
+    uniqueBookIDs.erase(entry.book.id);
+    bookRecords.remove(entry);
+    unlinkSortOrders(handle.slot);
+    markBookRemoved(books, index);
+    books.erase(books.begin() + index);
+    titleIndexDirty = true;
+}
+
+// Points loans at their book again after reloaded books were filed under new handles
+void relinkLoans() {
+    for (auto& loan : loanRecords) loan.book = findBookHandle(loan.id);
+    for (auto& overflow : loanOverflow) overflow.loan.book = findBookHandle(overflow.loan.id);
+    borrowerTracker.dirtyFrom = 0;
+    bumpTitleVersion();
+}
+
+ReloadCounts applyBookChanges(const map<int, string>& upserts, const set<int>& removals) {
+    ReloadCounts counts;
+    bool refiled = false;
+    for (int id : removals) {
+        BookHandle handle = findBookHandle(id);
+        if (!resolveBook(handle)) continue;
+        removeBook(handle);
+        counts.removed++;
+    }
+
+    for (const auto& record : upserts) {
+        Book book;
+        int category = parseBookLine(record.second, book);
+        if (category < 0) continue;
+
+        BookHandle handle = findBookHandle(book.id);
+        Book* current = resolveBook(handle);
+        if (current && book.owned < 0) book.owned = current->owned; // Edited with the older four-column layout
+        if (current && bookSlab[handle.slot].category == category) {
+            if (current->title == book.title && current->copies == book.copies && current->owned == book.owned) continue;
+            if (current->title != book.title) titleIndexDirty = true;
+            *current = book;
+            markBookChanged(*current);
+            emitBookChange(CHANGE_BOOK_CHANGED, *current);
+            bookRecords.store(bookSlab[handle.slot]);
+            counts.changed++;
+            continue;
+        }
+
+        // New, or moved to another category: filed afresh under a new handle
+        if (current) {
+            removeBook(handle);
+            counts.changed++;
+        } else {
+            counts.added++;
+        }
+        handle = categoryLists[category]->push_back(book);
+        uniqueBookIDs.insert(book.id);
+        noteSharedChange(SHARED_BOOK, book.id);
+        emitBookChange(CHANGE_BOOK_ADDED, book);
+        bookRecords.store(bookSlab[handle.slot]);
+        linkSortOrders(handle.slot);
+        titleIndexDirty = true;
+        refiled = true;
+    }
+    if (refiled) relinkLoans();
+    return counts;
+}
+
+void removeBorrower(Borrower& borrower) {
+    int id = borrower.id;
+    noteSharedChange(SHARED_BORROWER, id);
+    emitBorrowerChange(CHANGE_BORROWER_REMOVED, borrower);
+    bumpBorrowerVersion(id);
+    dropLoanStats(borrower);
+    unindexBorrowerName(borrower);
+    uniqueBorrowerIDs.erase(id);
+    if (borrowerStore.enabled()) {
+        borrowerStore.erase(id);
+        return;
+    }
+    size_t index = size_t(&borrower - borrowers.data());
+    releaseOverflowLoans(borrower);
+    borrowers.erase(borrowers.begin() + index);
+    borrowerTracker.dirtyFrom = min(borrowerTracker.dirtyFrom, index / SNAPSHOT_CHUNK);
+}
+
+ReloadCounts applyBorrowerChanges(const map<int, string>& upserts, const set<int>& removals) {
+    ReloadCounts counts;
+    for (int id : removals) {
+        Borrower* borrower = findBorrower(id);
+        if (!borrower) continue;
+        removeBorrower(*borrower);
+        counts.removed++;
+    }
+
+    vector<BorrowedBookDetails> scratch;
+    for (const auto& record : upserts) {
+        Borrower* current = findBorrower(record.first);
+        if (current && serializeBorrower(*current) == record.second) continue;
+
+        // As in loadBorrowers(), memory mode parses straight into the loan array
+        vector<BorrowedBookDetails>& loans = borrowerStore.enabled() ? scratch : loanRecords;
+        scratch.clear();
+        Borrower parsed;
+        if (!parseBorrowerRecord(record.second, loans, parsed)) continue;
+        noteSharedChange(SHARED_BORROWER, parsed.id);
+        bumpBorrowerVersion(parsed.id);
+        if (current) {
+            // The old loan range is left behind in the loan array until compactLoans()
+            dropLoanStats(*current);
+            unindexBorrowerName(*current);
+            if (borrowerStore.enabled()) {
+                borrowerStore.replace(parsed, scratch.data());
+            } else {
+                releaseOverflowLoans(*current);
+                *current = parsed;
+                markBorrowerChanged(*current);
+            }
+            counts.changed++;
+        } else {
+            if (borrowerStore.enabled()) borrowerStore.insert(parsed, scratch.data());
+            else borrowers.push_back(parsed);
+            uniqueBorrowerIDs.insert(parsed.id);
+            counts.added++;
+        }
+        addLoanStats(parsed, loans.data());
+        indexBorrowerName(parsed);
+        emitBorrowerChange(current ? CHANGE_BORROWER_CHANGED : CHANGE_BORROWER_ADDED, parsed);
+    }
+    return counts;
+}
+
+string reloadSummary(const string& label, const ReloadCounts& counts) {
+    ostringstream out;
+    out << "\t" << label << ": " << counts.added << " added, " << counts.changed << " changed, "
+        << counts.removed << " removed.\n";
+    return out.str();
+}
+
+// Called by the main menu between screens, so no screen is holding a reference into the data
+string applyPendingReloads() {
+    TraceSpan span("applyPendingReloads");
+    map<int, string> bookUpserts, borrowerUpserts;
+    set<int> bookRemovals, borrowerRemovals;
+    {
+        lock_guard<mutex> lock(reloadMutex);
+        bookUpserts.swap(watchedBooks.upserts);
+        bookRemovals.swap(watchedBooks.removals);
+        borrowerUpserts.swap(watchedBorrowers.upserts);
+        borrowerRemovals.swap(watchedBorrowers.removals);
+    }
+
+    string summary = applySharedChanges();
+    // Books first, so reloaded loans can link to books that arrived in the same import
+    if (!bookUpserts.empty() || !bookRemovals.empty()) {
+        summary += reloadSummary("Reloaded " + BOOKS_FILE, applyBookChanges(bookUpserts, bookRemovals));
+    }
+    if (!borrowerUpserts.empty() || !borrowerRemovals.empty()) {
+        summary += reloadSummary("Reloaded " + BORROWERS_FILE, applyBorrowerChanges(borrowerUpserts, borrowerRemovals));
+    }
+    if (!summary.empty()) publishSnapshot();
+    return summary;
+}
+
+#ifndef _WIN32
+// kill() with no signal: true while the process exists, even one we may not signal
+bool processAlive(int32_t pid) {
+    return kill(pid_t(pid), 0) == 0 || errno == EPERM;
+}
+#endif
+
+// Opens the named segment, creating it if no terminal has yet. A creator has only the header
+// until populateSharedCatalog() sizes the rest from the loaded data; a joiner waits for that,
+// and starts over with a new segment if the creator died or gave up first.
+bool SharedCatalog::open(const string& segmentName) {
+#ifdef _WIN32
+    (void)segmentName;
+    return false;
+#else
+    static_assert(sizeof(SharedCatalogHeader) <= SHARED_HEADER_BYTES, "the shared header must fit its page");
+    name = segmentName[0] == '/' ? segmentName : "/" + segmentName;
+    pid = int32_t(getpid());
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        created = fd >= 0;
+        if (!created && errno == EEXIST) fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) {
+            if (errno == ENOENT) continue; // Removed between the two calls
+            return false;
+        }
+        if (created && ftruncate(fd, off_t(SHARED_HEADER_BYTES)) != 0) {
+            ::close(fd);
+            fd = -1;
+            shm_unlink(name.c_str());
+            return false;
+        }
+
+        // Beyond the object's end until it grows, which is why nothing past segmentBytes is touched
+        void* mapping = mmap(nullptr, SHARED_CATALOG_MAX_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd);
+            fd = -1;
+            if (created) shm_unlink(name.c_str());
+            return false;
+        }
+        base = static_cast<char*>(mapping);
+        size = SHARED_CATALOG_MAX_BYTES;
+
+        if (created) {
+            SharedCatalogHeader* fresh = new (base) SharedCatalogHeader();
+            pthread_mutexattr_t attributes;
+            pthread_mutexattr_init(&attributes);
+            pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+            pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+            pthread_mutex_init(&fresh->lock, &attributes);
+            pthread_mutexattr_destroy(&attributes);
+            fresh->creator = pid;
+            fresh->segmentBytes = SHARED_HEADER_BYTES;
+            fresh->tableOffset = SHARED_HEADER_BYTES;
+            fresh->arenaOffset = SHARED_HEADER_BYTES;
+            memcpy(fresh->magic, SHARED_CATALOG_MAGIC, sizeof(fresh->magic));
+        } else if (!awaitCreator()) {
+            detach();
+            continue;
+        }
+        if (!attach()) {
+            if (created) abandon();
+            else detach();
+            return false;
+        }
+        return true;
+    }
+    return false;
+#endif
+}
+
+// Joiner: waits while the creator fills the segment. A creator that died first, or a segment
+// that never named one, is removed so the next attempt makes a new segment.
+bool SharedCatalog::awaitCreator() {
+#ifndef _WIN32
+    for (int waited = 0;; waited += 10) {
+        struct stat info;
+        bool sized = fstat(fd, &info) == 0 && size_t(info.st_size) >= SHARED_HEADER_BYTES; // Touching it sooner would fault
+        int32_t creator = 0;
+        if (sized && memcmp(header()->magic, SHARED_CATALOG_MAGIC, sizeof(header()->magic)) == 0) {
+            uint32_t state = header()->ready.load();
+            if (state == SHARED_READY) return true;
+            if (state == SHARED_ABANDONED) return false; // Its creator already removed it
+            creator = header()->creator;
+        }
+        if (creator > 0 ? !processAlive(creator) : waited >= SHARED_CREATOR_WAIT_MS) {
+            unlinkIfCurrent();
+            return false;
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+#else
+    return false;
+#endif
+}
+
+// Takes an entry in the terminal table, reclaiming one left by a terminal that died
+bool SharedCatalog::attach() {
+#ifndef _WIN32
+    lock();
+    SharedTerminal* terminals = header()->terminals;
+    terminal = SharedCatalogHeader::MAX_TERMINALS;
+    for (uint32_t i = 0; i < SharedCatalogHeader::MAX_TERMINALS; ++i) {
+        if (terminals[i].pid != 0 && !processAlive(terminals[i].pid)) terminals[i] = SharedTerminal();
+        if (terminals[i].pid == 0 && terminal == SharedCatalogHeader::MAX_TERMINALS) terminal = i;
+    }
+    if (terminal < SharedCatalogHeader::MAX_TERMINALS) {
+        terminals[terminal] = SharedTerminal();
+        terminals[terminal].pid = pid;
+        terminals[terminal].seen = header()->sequence.load();
+    }
+    unlock();
+    return terminal < SharedCatalogHeader::MAX_TERMINALS;
+#else
+    return false;
+#endif
+}
+
+// Creator only: gives up on a segment it could not fill, so waiting joiners start over
+void SharedCatalog::abandon() {
+#ifndef _WIN32
+    header()->ready.store(SHARED_ABANDONED);
+    unlinkIfCurrent();
+    detach();
+#endif
+}
+
+// The last terminal out removes the segment; by then it has saved everything to the text files
+void SharedCatalog::leave() {
+#ifndef _WIN32
+    if (!enabled()) return;
+    lock();
+    header()->terminals[terminal] = SharedTerminal();
+    bool last = true;
+    for (const SharedTerminal& other : header()->terminals) {
+        if (other.pid != 0 && processAlive(other.pid)) last = false;
+    }
+    unlock();
+    if (last) unlinkIfCurrent();
+    detach();
+#endif
+}
+
+void SharedCatalog::detach() {
+#ifndef _WIN32
+    if (base) munmap(base, size);
+    if (fd >= 0) ::close(fd);
+    base = nullptr;
+    fd = -1;
+#endif
+}
+
+// Removes the name only while it still refers to our segment, not one a later terminal made
+void SharedCatalog::unlinkIfCurrent() {
+#ifndef _WIN32
+    int current = shm_open(name.c_str(), O_RDONLY, 0);
+    if (current < 0) return;
+    struct stat ours, named;
+    if (fstat(fd, &ours) == 0 && fstat(current, &named) == 0 && ours.st_ino == named.st_ino) shm_unlink(name.c_str());
+    ::close(current);
+#endif
+}
+
+void SharedCatalog::lock() {
+#ifndef _WIN32
+    // A terminal that died holding the lock may have left one record half-written; carry on
+    if (pthread_mutex_lock(&header()->lock) == EOWNERDEAD) pthread_mutex_consistent(&header()->lock);
+#endif
+}
+
+void SharedCatalog::unlock() {
+#ifndef _WIN32
+    pthread_mutex_unlock(&header()->lock);
+#endif
+}
+
+// Caller holds the lock. Returns null when the record is absent, or when there is no room for
+// it. A new record takes a removed record's slot once every terminal has applied the removal,
+// and the table is rebuilt larger before it gets more than three quarters full.
+SharedRecord* SharedCatalog::find(uint8_t kind, int id, bool create) {
+    if (create && (header()->usedSlots + 1) * 4 > uint64_t(header()->tableSlots) * 3) rehash(0);
+    if (header()->tableSlots == 0) return nullptr;
+
+    uint32_t mask = header()->tableSlots - 1;
+    uint32_t at = (uint32_t(id) * 2654435761u + kind) & mask;
+    SharedRecord* vacant = nullptr;
+    SharedRecord* reusable = nullptr;
+    uint64_t oldest = 0;
+    bool oldestKnown = false;
+    for (uint32_t probe = 0; probe <= mask; ++probe, at = (at + 1) & mask) {
+        SharedRecord& record = table()[at];
+        if (record.id == id && record.kind == kind) return &record;
+        if (record.id == 0) {
+            vacant = &record;
+            break;
+        }
+        if (create && !reusable && record.removed) {
+            if (!oldestKnown) {
+                oldest = oldestSeen();
+                oldestKnown = true;
+            }
+            if (record.sequence <= oldest) reusable = &record;
+        }
+    }
+    if (!create) return nullptr;
+
+    SharedRecord* record = reusable ? reusable : vacant;
+    if (!record) return nullptr;
+    if (record == vacant) header()->usedSlots++;
+    *record = SharedRecord();
+    record->id = id;
+    record->kind = kind;
+    record->removed = 1;
+    record->order = header()->nextOrder++;
+    return record;
+}
+
+// Caller holds the lock. Lines are appended; superseded text is reclaimed by compact(), and
+// the arena grows to twice what it holds when that is not enough
+bool SharedCatalog::storeLine(SharedRecord& record, const string& line) {
+    if (header()->arenaOffset + header()->arenaUsed + line.size() > header()->segmentBytes) {
+        compact();
+        uint64_t wanted = header()->arenaOffset + 2 * (header()->arenaUsed + line.size());
+        if (!growTo(wanted) && header()->arenaOffset + header()->arenaUsed + line.size() > header()->segmentBytes) return false;
+    }
+    record.offset = header()->arenaOffset + header()->arenaUsed;
+    record.length = uint32_t(line.size());
+    memcpy(base + record.offset, line.data(), line.size());
+    header()->arenaUsed += line.size();
+    return true;
+}
+
+// Caller holds the lock. Packs the live lines to the front of the arena
+void SharedCatalog::compact() {
+    string live;
+    vector<SharedRecord*> records;
+    for (uint32_t i = 0; i < header()->tableSlots; ++i) {
+        SharedRecord& record = table()[i];
+        if (record.id == 0 || record.removed) continue;
+        live += lineOf(record);
+        records.push_back(&record);
+    }
+    uint64_t offset = header()->arenaOffset;
+    for (SharedRecord* record : records) {
+        record->offset = offset;
+        offset += record->length;
+    }
+    memcpy(base + header()->arenaOffset, live.data(), live.size());
+    header()->arenaUsed = live.size();
+}
+
+// Caller holds the lock. Rebuilds the table with four slots per record it keeps (or per
+// expected record, for the creator), dropping removals every terminal has applied, and moves
+// the arena to just behind it
+bool SharedCatalog::rehash(size_t records) {
+    SharedCatalogHeader* h = header();
+    uint64_t oldest = oldestSeen();
+    vector<SharedRecord> kept;
+    for (uint32_t i = 0; i < h->tableSlots; ++i) {
+        const SharedRecord& record = table()[i];
+        if (record.id != 0 && !(record.removed && record.sequence <= oldest)) kept.push_back(record);
+    }
+    uint64_t slots = SHARED_TABLE_MIN_SLOTS;
+    while (slots < 4 * uint64_t(max(records, kept.size() + 1))) slots *= 2;
+
+    uint64_t arenaOffset = h->tableOffset + slots * sizeof(SharedRecord);
+    uint64_t arenaBytes = h->segmentBytes - h->arenaOffset;
+    if (slots > UINT32_MAX || !growTo(arenaOffset + arenaBytes)) return false;
+    memmove(base + arenaOffset, base + h->arenaOffset, h->arenaUsed);
+    int64_t shift = int64_t(arenaOffset) - int64_t(h->arenaOffset);
+    h->arenaOffset = arenaOffset;
+    h->tableSlots = uint32_t(slots);
+    h->usedSlots = kept.size();
+    memset(base + h->tableOffset, 0, slots * sizeof(SharedRecord));
+
+    uint32_t mask = h->tableSlots - 1;
+    for (SharedRecord& record : kept) {
+        record.offset = uint64_t(int64_t(record.offset) + shift);
+        uint32_t at = (uint32_t(record.id) * 2654435761u + record.kind) & mask;
+        while (table()[at].id != 0) at = (at + 1) & mask;
+        table()[at] = record;
+    }
+    return true;
+}
+
+// Caller holds the lock. Grows the object; every terminal already maps the new bytes
+bool SharedCatalog::growTo(uint64_t bytes) {
+#ifndef _WIN32
+    if (bytes <= header()->segmentBytes) return true;
+    bytes = min<uint64_t>(bytes, size);
+    if (bytes <= header()->segmentBytes || ftruncate(fd, off_t(bytes)) != 0) return false;
+    header()->segmentBytes = bytes;
+    return true;
+#else
+    (void)bytes;
+    return false;
+#endif
+}
+
+// Caller holds the lock
+void SharedCatalog::setSeen(uint64_t sequence) {
+    seen = sequence;
+    header()->terminals[terminal].seen = sequence;
+}
+
+// Caller holds the lock. Oldest sequence every attached terminal has applied
+uint64_t SharedCatalog::oldestSeen() const {
+    uint64_t oldest = header()->sequence.load();
+    for (const SharedTerminal& other : header()->terminals) {
+        if (other.pid != 0) oldest = min(oldest, other.seen);
+    }
+    return oldest;
+}
+
+// Caller holds the lock. Another live terminal holding changes it could not share, or 0
+int32_t SharedCatalog::terminalWithUnshared() const {
+#ifndef _WIN32
+    for (const SharedTerminal& other : header()->terminals) {
+        if (other.pid != 0 && other.pid != pid && other.unshared && processAlive(other.pid)) return other.pid;
+    }
+#endif
+    return 0;
+}
+
+string bookLine(const Book& book, uint8_t category) {
+    string line = CATEGORY_FILE_NAMES[category] + "," + to_string(book.id) + "," + book.title + "," + to_string(book.copies);
+    return book.owned < 0 ? line : line + "," + to_string(book.owned);
+}
+
+// The same books.txt line with the available count replaced by the shared one
+string withCopies(const string& line, int copies) {
+    Book book;
+    int category = parseBookLine(line, book);
+    if (category < 0) return line;
+    book.copies = copies;
+    return bookLine(book, uint8_t(category));
+}
+
+// Queues a local change to be written to the shared catalog at the next publishSnapshot()
+void noteSharedChange(uint8_t kind, int id) {
+    if (!sharedCatalog.enabled() || sharedCatalog.applying) return;
+    if (kind == SHARED_BOOK) sharedCatalog.bookChanges.insert(id);
+    else sharedCatalog.borrowerChanges.insert(id);
+}
+
+// Creator only: copies the freshly loaded catalog into a segment sized for it, then lets others
+// join. Joiners never see a partial copy: if any record does not fit, the segment is abandoned
+// and this terminal keeps the private copy it loaded from the files.
+void populateSharedCatalog() {
+    TraceSpan span("populateSharedCatalog");
+    if (!sharedCatalog.enabled()) return;
+    size_t books = 0;
+    for (auto category : categoryLists) books += category->size();
+    size_t people = borrowerStore.enabled() ? borrowerStore.order.size() : borrowers.size();
+
+    sharedCatalog.lock();
+    bool stored = sharedCatalog.rehash(books + people);
+    for (uint8_t c = 0; stored && c < 10; ++c) {
+        for (const auto& book : *categoryLists[c]) {
+            SharedRecord* record = sharedCatalog.find(SHARED_BOOK, book.id, true);
+            if (!record || !sharedCatalog.storeLine(*record, bookLine(book, c))) {
+                stored = false;
+                break;
+            }
+            record->removed = 0;
+            record->copies = book.copies;
+            sharedCatalog.copiesBase[book.id] = book.copies;
+        }
+    }
+    if (stored) {
+        forEachBorrower([&](const Borrower& borrower, const BorrowedBookDetails* loanBase) {
+            if (!stored) return;
+            SharedRecord* record = sharedCatalog.find(SHARED_BORROWER, borrower.id, true);
+            stored = record && sharedCatalog.storeLine(*record, serializeBorrower(borrower, loanBase));
+            if (stored) record->removed = 0;
+        });
+    }
+    sharedCatalog.unlock();
+
+    if (stored) {
+        sharedCatalog.header()->ready.store(SHARED_READY);
+        return;
+    }
+    sharedCatalog.abandon();
+    sharedCatalog.copiesBase.clear();
+    libraryNotice("Error: the shared catalog has no room for the data (shared memory is full or above " +
+                  to_string(SHARED_CATALOG_MAX_BYTES >> 20) + " MiB). Keeping a private copy of the data.\n");
+}
+
+// Joiner: builds this terminal's lists and indexes from the segment instead of the text files
+void loadSharedCatalog() {
+    TraceSpan span("loadSharedCatalog");
+    vector<const SharedRecord*> records;
+    sharedCatalog.lock();
+    for (uint32_t i = 0; i < sharedCatalog.header()->tableSlots; ++i) {
+        const SharedRecord& record = sharedCatalog.table()[i];
+        if (record.id != 0 && !record.removed) records.push_back(&record);
+    }
+    sort(records.begin(), records.end(), [](const SharedRecord* a, const SharedRecord* b) { return a->order < b->order; });
+
+    stringstream books, people;
+    for (const SharedRecord* record : records) {
+        if (record->kind == SHARED_BOOK) {
+            books << withCopies(sharedCatalog.lineOf(*record), record->copies) << "\n";
+            sharedCatalog.copiesBase[record->id] = record->copies;
+        } else {
+            people << sharedCatalog.lineOf(*record) << "\n";
+        }
+    }
+    sharedCatalog.setSeen(sharedCatalog.header()->sequence.load());
+    sharedCatalog.unlock();
+
+    loadBookLines(books, "the shared catalog");
+    loadBorrowerLines(people, "the shared catalog");
+}
+
+// Writes this terminal's queued changes. Copy counts are merged as deltas against the shared
+// count, so two terminals lending copies of one book at once both take effect. A change the
+// segment has no room for stays queued for the next try, and until it is shared no other
+// terminal may save over the files this one's copy is ahead of.
+void shareChanges() {
+    if (!sharedCatalog.enabled() || (sharedCatalog.bookChanges.empty() && sharedCatalog.borrowerChanges.empty())) return;
+    set<int> bookIDs, borrowerIDs;
+    bookIDs.swap(sharedCatalog.bookChanges);
+    borrowerIDs.swap(sharedCatalog.borrowerChanges);
+
+    sharedCatalog.lock();
+    uint64_t previous = sharedCatalog.header()->sequence.load();
+    uint64_t next = previous + 1;
+    vector<Book*> merged;
+    bool full = false; // After the first failure the rest wait too, rather than each compacting in vain
+    for (int id : bookIDs) {
+        SharedRecord* record = full ? nullptr : sharedCatalog.find(SHARED_BOOK, id, true);
+        if (!record) {
+            sharedCatalog.bookChanges.insert(id);
+            full = true;
+            continue;
+        }
+        BookHandle handle = findBookHandle(id);
+        Book* book = resolveBook(handle);
+        if (book) {
+            // The line is stored first, so a failure leaves both copy counts as they were
+            int& base = sharedCatalog.copiesBase[id];
+            Book shared = *book;
+            shared.copies = record->copies + book->copies - base;
+            if (!sharedCatalog.storeLine(*record, bookLine(shared, bookSlab[handle.slot].category))) {
+                sharedCatalog.bookChanges.insert(id);
+                full = true;
+                continue;
+            }
+            if (book->copies != shared.copies) merged.push_back(book);
+            record->copies = book->copies = base = shared.copies;
+            record->removed = 0;
+        } else {
+            record->removed = 1;
+            record->length = 0;
+            record->copies = 0;
+            sharedCatalog.copiesBase.erase(id);
+        }
+        record->writer = sharedCatalog.pid;
+        record->sequence = next;
+    }
+    for (int id : borrowerIDs) {
+        SharedRecord* record = full ? nullptr : sharedCatalog.find(SHARED_BORROWER, id, true);
+        if (!record) {
+            sharedCatalog.borrowerChanges.insert(id);
+            full = true;
+            continue;
+        }
+        if (Borrower* borrower = findBorrower(id)) {
+            if (!sharedCatalog.storeLine(*record, serializeBorrower(*borrower))) {
+                sharedCatalog.borrowerChanges.insert(id);
+                full = true;
+                continue;
+            }
+            record->removed = 0;
+        } else {
+            record->removed = 1;
+            record->length = 0;
+        }
+        record->writer = sharedCatalog.pid;
+        record->sequence = next;
+    }
+    sharedCatalog.header()->sequence.store(next);
+    if (sharedCatalog.seen == previous) sharedCatalog.setSeen(next); // Nobody else wrote in between
+    bool unshared = !sharedCatalog.bookChanges.empty() || !sharedCatalog.borrowerChanges.empty();
+    uint32_t& flagged = sharedCatalog.header()->terminals[sharedCatalog.terminal].unshared;
+    bool newlyUnshared = unshared && !flagged;
+    flagged = unshared;
+    sharedCatalog.unlock();
+
+    if (newlyUnshared) {
+        libraryNotice("Error: the shared catalog is full, so changes made here are only in this terminal. They are retried after "
+                      "every change; until they fit, other terminals cannot save.\n");
+    }
+
+    // Another terminal moved the count meanwhile; the merged total is what this one shows now
+    sharedCatalog.applying = true;
+    for (Book* book : merged) {
+        markBookChanged(*book);
+        if (BookSlot* entry = findBookSlot(*book)) bookRecords.storeCopies(*entry);
+    }
+    sharedCatalog.applying = false;
+}
+
+// Brings in what other terminals changed since this one last looked, through the same
+// path a reloaded data file takes
+string applySharedChanges() {
+    if (!sharedCatalog.enabled() || sharedCatalog.header()->sequence.load() == sharedCatalog.seen) return "";
+
+    map<int, string> bookUpserts, borrowerUpserts;
+    set<int> bookRemovals, borrowerRemovals;
+    sharedCatalog.lock();
+    uint64_t current = sharedCatalog.header()->sequence.load();
+    for (uint32_t i = 0; i < sharedCatalog.header()->tableSlots; ++i) {
+        const SharedRecord& record = sharedCatalog.table()[i];
+        if (record.id == 0 || record.sequence <= sharedCatalog.seen || record.writer == sharedCatalog.pid) continue;
+        if (record.kind == SHARED_BOOK) {
+            if (record.removed) {
+                bookRemovals.insert(record.id);
+                continue;
+            }
+            bookUpserts[record.id] = withCopies(sharedCatalog.lineOf(record), record.copies);
+            sharedCatalog.copiesBase[record.id] = record.copies;
+        } else if (record.removed) {
+            borrowerRemovals.insert(record.id);
+        } else {
+            borrowerUpserts[record.id] = sharedCatalog.lineOf(record);
+        }
+    }
+    sharedCatalog.setSeen(current);
+    sharedCatalog.unlock();
+
+    string summary;
+    sharedCatalog.applying = true;
+    if (!bookUpserts.empty() || !bookRemovals.empty()) {
+        summary += reloadSummary("Books changed in other terminals", applyBookChanges(bookUpserts, bookRemovals));
+    }
+    if (!borrowerUpserts.empty() || !borrowerRemovals.empty()) {
+        summary += reloadSummary("Borrowers changed in other terminals", applyBorrowerChanges(borrowerUpserts, borrowerRemovals));
+    }
+    sharedCatalog.applying = false;
+    return summary;
+}
+
+uint32_t crc32cSoftware(uint32_t crc, const unsigned char* data, size_t length) {
+    static const Crc32cTable table;
+    const auto& t = table.entries;
+    while (length >= 8) {
+        uint32_t low, high;
+        memcpy(&low, data, 4);
+        memcpy(&high, data + 4, 4);
+        low ^= crc;
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+              t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        data += 8;
+        length -= 8;
+    }
+    while (length--) crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+    return crc;
+}
+
+#if CRC32C_HARDWARE
+// SSE4.2 crc32 instruction, eight bytes per step
+__attribute__((target("sse4.2"))) uint32_t crc32cHardware(uint32_t crc, const unsigned char* data, size_t length) {
+#ifdef __x86_64__
+    uint64_t wide = crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = uint32_t(wide);
+#endif
+    for (; length >= 4; data += 4, length -= 4) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        crc = _mm_crc32_u32(crc, word);
+    }
+    while (length--) crc = _mm_crc32_u8(crc, *data++);
+    return crc;
+}
+#endif
+
+uint32_t crc32c(const char* data, size_t length) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+#if CRC32C_HARDWARE
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware) return ~crc32cHardware(~0u, bytes, length);
+#endif
+    return ~crc32cSoftware(~0u, bytes, length);
+}
+
+// Sidecar layout: "crc32c <block size> <file length> <whole-file crc> <modified>", then one crc per
+// block. Only called for files this program has just written and closed, so the modification time
+// recorded is the one our save left; a later time means someone else has written the file since.
+void writeChecksumFile(const string& path, const string& content) {
+    TraceSpan span("write checksums");
+    ofstream outFile(path + CHECKSUM_SUFFIX, ios::binary);
+    if (!outFile.is_open()) {
+        libraryNotice("Error opening checksum file for " + path + ".\n");
+        return;
+    }
+    outFile << hex << setfill('0');
+    outFile << "crc32c " << dec << CHECKSUM_BLOCK << " " << content.size() << " " << hex << setw(8) << crc32c(content.data(), content.size())
+            << " " << dec << stampOf(path).modified << hex << "\n";
+    for (size_t begin = 0; begin < content.size(); begin += CHECKSUM_BLOCK) {
+        outFile << setw(8) << crc32c(content.data() + begin, min(CHECKSUM_BLOCK, content.size() - begin)) << "\n";
+    }
+}
+
+// Checks the content against its sidecar, naming each block that no longer matches.
+// A file written since our last save was edited on purpose and is taken as it is. Otherwise a
+// mismatch is damage: the content as read is kept in <path>.damaged before the loader skips what
+// it cannot parse, since the next save rewrites the file from what did load.
+// Returns false when damage was found; a file with no sidecar yet passes.
+bool verifyChecksumFile(const string& path, const string& content) {
+    TraceSpan span("verify checksums");
+    ifstream inFile(path + CHECKSUM_SUFFIX);
+    if (!inFile.is_open()) return true;
+
+    string header, format;
+    size_t blockSize = 0, recordedLength = 0;
+    uint32_t wholeFile = 0;
+    int64_t recordedModified = 0; // Absent from sidecars written before it was recorded
+    getline(inFile, header);
+    istringstream fields(header);
+    fields >> format >> blockSize >> recordedLength >> hex >> wholeFile;
+    if (!fields || format != "crc32c" || blockSize == 0) {
+        libraryNotice("Error reading the checksum file for " + path + "; the file was not checked.\n");
+        return true;
+    }
+    fields >> dec >> recordedModified;
+    inFile >> hex; // Block checksums follow, one per line
+    if (recordedLength == content.size() && wholeFile == crc32c(content.data(), content.size())) return true;
+
+    if (recordedModified != 0 && stampOf(path).modified != recordedModified) {
+        libraryNotice(path + " was changed outside the program since it was last saved; it will be checksummed again on the next save.\n");
+        return true;
+    }
+
+    if (recordedLength != content.size()) {
+        libraryNotice("Checksum warning: " + path + " is " + to_string(content.size()) + " bytes, but " + to_string(recordedLength) +
+                      " were saved; it may have been cut short or written by another program.\n");
+    }
+    size_t lineStart = 1;
+    size_t blocks = (content.size() + blockSize - 1) / blockSize;
+    for (size_t block = 0; block < blocks; ++block) {
+        size_t begin = block * blockSize;
+        size_t length = min(blockSize, content.size() - begin);
+        size_t lastLine = lineStart + size_t(count(content.begin() + begin, content.begin() + begin + length - 1, '\n'));
+        size_t nextLine = lastLine + (content[begin + length - 1] == '\n' ? 1 : 0);
+
+        uint32_t recorded;
+        bool matches = bool(inFile >> recorded) && begin + length <= recordedLength && recorded == crc32c(content.data() + begin, length);
+        if (!matches) {
+            ostringstream notice;
+            notice << "Checksum mismatch in " << path << " block " << block << " (bytes " << begin << "-" << begin + length - 1
+                   << ", lines " << lineStart << "-" << lastLine << "); this part of the file may be damaged.\n";
+            libraryNotice(notice.str());
+        }
+        lineStart = nextLine;
+    }
+
+    ofstream backup(path + DAMAGED_SUFFIX, ios::binary);
+    backup << content;
+    backup.close();
+    if (backup) {
+        libraryNotice("The damaged " + path + " was copied to " + path + DAMAGED_SUFFIX + "; records that could not be read are missing "
+                      "until it is repaired, and the next save rewrites " + path + " without them.\n");
+    } else {
+        libraryNotice("Error copying the damaged " + path + " to " + path + DAMAGED_SUFFIX + "; keep a copy before the next save rewrites it.\n");
+    }
+    return false;
+}
+
+// Reports a record the loader had to skip; past LOAD_ERROR_LIMIT they are only counted
+void reportLoadError(const string& source, size_t lineNumber, const string& problem, size_t& errors) {
+    if (++errors <= LOAD_ERROR_LIMIT) {
+        libraryNotice("Error in " + source + " line " + to_string(lineNumber) + ": " + problem + ". Record skipped.\n");
+    }
+}
+
+void reportLoadErrorTotal(const string& source, size_t errors) {
+    if (errors > LOAD_ERROR_LIMIT) {
+        libraryNotice("Error in " + source + ": " + to_string(errors - LOAD_ERROR_LIMIT) + " more records skipped.\n");
+    }
+}
+
+string readWholeFile(ifstream& inFile) {
+    TraceSpan span("read file");
+    return string(istreambuf_iterator<char>(inFile), istreambuf_iterator<char>());
+}
+
+// Open loans of one borrower, tallied by the slab slot of the book they hold; an open loan
+// whose book is no longer in the catalog is set aside instead. Returns the loans looked at.
+size_t tallyOpenLoans(const Borrower& borrower, const BorrowedBookDetails* loanBase, vector<int>& openBySlot, vector<DanglingLoan>& dangling) {
+    size_t loans = 0;
+    for (const auto& loan : loansOf(borrower, loanBase)) {
+        loans++;
+        if (loan.returnDay != NOT_RETURNED) continue;
+        BookHandle handle = loan.book;
+        Book* book = resolveBook(handle);
+        if (!book || book->id != loan.id) {
+            handle = findBookHandle(loan.id);
+            book = resolveBook(handle);
+        }
+        if (book) openBySlot[handle.slot]++;
+        else dangling.push_back({borrower.id, loan.id, dateFromDays(loan.borrowDay)});
+    }
+    return loans;
+}
+
+// Joins every open loan against the catalog. Borrower chunks of the pinned snapshot are split
+// across threads, each counting into its own per-slot array, and the arrays are summed after.
+// With the disk store the borrowers are not in the snapshot, so they are streamed on this thread.
+InventoryReport reconcileInventory() {
+    TraceSpan span("reconcileInventory");
+    InventoryReport report;
+    shared_ptr<const LibrarySnapshot> snapshot = pinSnapshot();
+    const auto& chunks = snapshot->borrowerChunks;
+
+    size_t threadCount = borrowerStore.enabled() ? 1 : min<size_t>(max(1u, thread::hardware_concurrency()), max<size_t>(1, chunks.size()));
+    vector<vector<int>> openBySlot(threadCount, vector<int>(bookSlab.size(), 0));
+    vector<vector<DanglingLoan>> dangling(threadCount);
+    vector<size_t> loansChecked(threadCount, 0);
+
+    auto scan = [&](size_t worker) {
+        TraceSpan span("tally open loans");
+        for (size_t c = worker; c < chunks.size(); c += threadCount) {
+            const BorrowerChunk& chunk = *chunks[c];
+            for (const auto& borrower : chunk.borrowers) {
+                loansChecked[worker] += tallyOpenLoans(borrower, chunk.loans.data(), openBySlot[worker], dangling[worker]);
+            }
+        }
+    };
+
+    if (borrowerStore.enabled()) {
+        forEachBorrower([&](const Borrower& borrower, const BorrowedBookDetails* loanBase) {
+            loansChecked[0] += tallyOpenLoans(borrower, loanBase, openBySlot[0], dangling[0]);
+        });
+    } else {
+        vector<thread> workers;
+        for (size_t worker = 1; worker < threadCount; ++worker) {
+            workers.emplace_back(scan, worker);
+        }
+        scan(0);
+        for (auto& worker : workers) worker.join();
+    }
+
+    vector<int>& onLoan = openBySlot[0];
+    for (size_t worker = 0; worker < threadCount; ++worker) {
+        if (worker > 0) {
+            for (size_t slot = 0; slot < onLoan.size(); ++slot) onLoan[slot] += openBySlot[worker][slot];
+        }
+        report.loansChecked += loansChecked[worker];
+        report.dangling.insert(report.dangling.end(), dangling[worker].begin(), dangling[worker].end());
+    }
+    sort(report.dangling.begin(), report.dangling.end(), [](const DanglingLoan& a, const DanglingLoan& b) {
+        return a.borrowerID != b.borrowerID ? a.borrowerID < b.borrowerID : a.bookID < b.bookID;
+    });
+
+    // Every ID with the category it was filed under; an ID filed twice cannot be reconciled
+    vector<pair<int, uint8_t>> filed;
+    for (uint8_t c = 0; c < 10; ++c) {
+        for (const auto& chunk : snapshot->categoryChunks[c]) {
+            for (const auto& book : *chunk) filed.push_back({book.id, c});
+        }
+    }
+    sort(filed.begin(), filed.end());
+    set<int> duplicated;
+    for (size_t i = 0; i < filed.size();) {
+        size_t end = i + 1;
+        while (end < filed.size() && filed[end].first == filed[i].first) end++;
+        if (end - i > 1) {
+            DuplicateBookID duplicate{filed[i].first, {}};
+            for (size_t j = i; j < end; ++j) duplicate.categories.push_back(filed[j].second);
+            report.duplicates.push_back(duplicate);
+            duplicated.insert(filed[i].first);
+        }
+        i = end;
+    }
+    report.booksChecked = filed.size();
+
+    for (uint8_t c = 0; c < 10; ++c) {
+        for (const auto& chunk : snapshot->categoryChunks[c]) {
+            for (const auto& book : *chunk) {
+                BookHandle handle = findBookHandle(book.id);
+                if (duplicated.count(book.id) || !resolveBook(handle)) continue;
+                int out = onLoan[handle.slot];
+                if (book.owned < 0) {
+                    // Saved before owned counts were kept: today's figures become the baseline,
+                    // filed like any other edit so other terminals, caches and books.dat see it
+                    Book& live = *resolveBook(handle);
+                    live.owned = book.copies + out;
+                    markBookChanged(live);
+                    emitBookChange(CHANGE_BOOK_CHANGED, live);
+                    bookRecords.store(bookSlab[handle.slot]);
+                    report.baselined++;
+                } else if (book.copies + out != book.owned) {
+                    report.drift.push_back({book.id, book.owned, book.copies, out});
+                }
+            }
+        }
+    }
+    if (report.baselined > 0) publishSnapshot();
+    return report;
+}
+
+// Distinct book IDs in one borrower's history, returned or not
+vector<int> historyBookIDs(const Borrower& borrower, const BorrowedBookDetails* loanBase) {
+    vector<int> ids;
+    for (const auto& loan : loansOf(borrower, loanBase)) ids.push_back(loan.id);
+    sort(ids.begin(), ids.end());
+    ids.erase(unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+void rankCoBorrows(CoBorrowRow& row) {
+    row.top.clear();
+    for (const auto& count : row.counts) row.top.push_back({count.first, count.second});
+    size_t keep = min(COBORROW_TOP_K, row.top.size());
+    partial_sort(row.top.begin(), row.top.begin() + keep, row.top.end());
+    row.top.resize(keep);
+}
+
+// Counts only grow, so a book outside the top list can only get in by passing the last one
+void offerCoBorrow(CoBorrowRow& row, const CoBorrow& candidate) {
+    auto existing = find_if(row.top.begin(), row.top.end(), [&](const CoBorrow& kept) { return kept.bookID == candidate.bookID; });
+    if (existing != row.top.end()) {
+        *existing = candidate;
+    } else if (row.top.size() < COBORROW_TOP_K) {
+        row.top.push_back(candidate);
+    } else if (candidate < row.top.back()) {
+        row.top.back() = candidate;
+    } else {
+        return;
+    }
+    sort(row.top.begin(), row.top.end());
+}
+
+// Three passes. First each borrower's history is reduced to its distinct book IDs, by snapshot
+// chunk across threads (streamed on this thread with the disk store). Then each thread counts
+// the pairs in its own slice of the histories. Last, each thread merges and ranks the rows of
+// the book IDs it owns, so every pass touches each history or row once and nothing is locked.
+void buildCoBorrowIndex() {
+    TraceSpan span("buildCoBorrowIndex");
+    vector<vector<int>> histories;
+    if (borrowerStore.enabled()) {
+        forEachBorrower([&](const Borrower& borrower, const BorrowedBookDetails* loanBase) {
+            histories.push_back(historyBookIDs(borrower, loanBase));
+        });
+    } else {
+        shared_ptr<const LibrarySnapshot> snapshot = pinSnapshot();
+        const auto& chunks = snapshot->borrowerChunks;
+        vector<size_t> firstOfChunk(chunks.size() + 1, 0);
+        for (size_t c = 0; c < chunks.size(); ++c) firstOfChunk[c + 1] = firstOfChunk[c] + chunks[c]->borrowers.size();
+        histories.resize(firstOfChunk.back());
+
+        size_t threadCount = min<size_t>(max(1u, thread::hardware_concurrency()), max<size_t>(1, chunks.size()));
+        auto reduce = [&](size_t worker) {
+            TraceSpan span("reduce loan histories");
+            for (size_t c = worker; c < chunks.size(); c += threadCount) {
+                const BorrowerChunk& chunk = *chunks[c];
+                for (size_t b = 0; b < chunk.borrowers.size(); ++b) {
+                    histories[firstOfChunk[c] + b] = historyBookIDs(chunk.borrowers[b], chunk.loans.data());
+                }
+            }
+        };
+        vector<thread> workers;
+        for (size_t worker = 1; worker < threadCount; ++worker) workers.emplace_back(reduce, worker);
+        reduce(0);
+        for (auto& worker : workers) worker.join();
+    }
+
+    // Each thread counts the pairs of its own slice of the histories, filing every row under
+    // the thread that will own that book ID when the partial counts are merged
+    size_t threadCount = min<size_t>(max(1u, thread::hardware_concurrency()), max<size_t>(1, histories.size()));
+    vector<vector<unordered_map<int, CoBorrowRow>>> partial(threadCount, vector<unordered_map<int, CoBorrowRow>>(threadCount));
+    auto count = [&](size_t worker) {
+        TraceSpan span("count co-borrowed pairs");
+        size_t first = histories.size() * worker / threadCount, last = histories.size() * (worker + 1) / threadCount;
+        for (size_t h = first; h < last; ++h) {
+            const vector<int>& ids = histories[h];
+            if (ids.size() < 2) continue;
+            for (size_t i = 0; i < ids.size(); ++i) {
+                CoBorrowRow& row = partial[worker][size_t(ids[i]) % threadCount][ids[i]];
+                for (size_t j = 0; j < ids.size(); ++j) {
+                    if (j != i) row.counts[ids[j]]++;
+                }
+            }
+        }
+    };
+    auto merge = [&](size_t owner) {
+        TraceSpan span("merge co-borrowed pairs");
+        unordered_map<int, CoBorrowRow>& rows = partial[0][owner];
+        for (size_t worker = 1; worker < threadCount; ++worker) {
+            for (auto& row : partial[worker][owner]) {
+                CoBorrowRow& merged = rows[row.first];
+                if (merged.counts.empty()) {
+                    merged.counts.swap(row.second.counts);
+                } else {
+                    for (const auto& count : row.second.counts) merged.counts[count.first] += count.second;
+                }
+            }
+            partial[worker][owner].clear();
+        }
+        for (auto& row : rows) rankCoBorrows(row.second);
+    };
+    vector<thread> workers;
+    for (size_t worker = 1; worker < threadCount; ++worker) workers.emplace_back(count, worker);
+    count(0);
+    for (auto& worker : workers) worker.join();
+    workers.clear();
+    for (size_t owner = 1; owner < threadCount; ++owner) workers.emplace_back(merge, owner);
+    merge(0);
+    for (auto& worker : workers) worker.join();
+
+    coBorrowIndex.clear();
+    for (size_t owner = 0; owner < threadCount; ++owner) {
+        coBorrowIndex.merge(partial[0][owner]); // Moves the nodes; the owners' key sets are disjoint
+    }
+    coBorrowDirty = false;
+}
+
+// Called by recordBorrow() once the loan is appended. Only a book new to the borrower's history
+// adds pairs: one with every other book in it.
+void noteCoBorrow(const Borrower& borrower, int bookID) {
+    if (coBorrowDirty) return; // The next lookup rebuilds everything anyway
+    int held = 0;
+    for (const auto& loan : loansOf(borrower)) {
+        if (loan.id == bookID) held++;
+    }
+    if (held != 1) return;
+
+    for (int other : historyBookIDs(borrower)) {
+        if (other == bookID) continue;
+        int together = ++coBorrowIndex[bookID].counts[other];
+        CoBorrowRow& otherRow = coBorrowIndex[other];
+        otherRow.counts[bookID] = together;
+        offerCoBorrow(otherRow, {bookID, together});
+        offerCoBorrow(coBorrowIndex[bookID], {other, together});
+    }
+}
+
+// The ranking is kept ready, so a lookup copies at most COBORROW_TOP_K entries
+vector<CoBorrow> alsoBorrowed(int bookID) {
+    if (coBorrowDirty) buildCoBorrowIndex();
+    auto row = coBorrowIndex.find(bookID);
+    return row == coBorrowIndex.end() ? vector<CoBorrow>() : row->second.top;
+}
+
+// Producer side: fails instead of waiting when the writer has fallen a full ring behind
+bool ChangeRing::push(const ChangeEvent& event) {
+    uint64_t position = head.load(memory_order_relaxed);
+    if (position - tail.load(memory_order_acquire) == CAPACITY) return false;
+    slots[position & (CAPACITY - 1)] = event;
+    head.store(position + 1, memory_order_release);
+    return true;
+}
+
+size_t ChangeRing::pop(vector<ChangeEvent>& batch, size_t limit) {
+    uint64_t position = tail.load(memory_order_relaxed);
+    uint64_t available = head.load(memory_order_acquire) - position;
+    size_t count = size_t(min<uint64_t>(available, limit));
+    for (size_t i = 0; i < count; ++i) batch.push_back(slots[(position + i) & (CAPACITY - 1)]);
+    tail.store(position + count, memory_order_release);
+    return count;
+}
+
+// Queues a mutation made in this terminal. Changes applied from other terminals are skipped,
+// since the terminal that made them streams them. A full ring drops the event rather than
+// hold up the desk; its sequence number is still used, so readers see the gap.
+void emitChange(ChangeEvent& event) {
+    if (!changeCapture.enabled || sharedCatalog.applying) return;
+    event.sequence = changeCapture.nextSequence++;
+    event.timeMs = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    if (!changeCapture.ring.push(event)) changeCapture.dropped.fetch_add(1, memory_order_relaxed);
+}
+
+void emitLoanChange(uint8_t kind, int borrowerID, int bookID, int borrowDay, int returnDay, int fee) {
+    if (!changeCapture.enabled) return;
+    ChangeEvent event = {};
+    event.kind = kind;
+    event.borrowerID = borrowerID;
+    event.bookID = bookID;
+    event.borrowDay = borrowDay;
+    event.returnDay = returnDay;
+    event.fee = fee;
+    emitChange(event);
+}
+
+void emitBookChange(uint8_t kind, const Book& book) {
+    if (!changeCapture.enabled) return;
+    ChangeEvent event = {};
+    event.kind = kind;
+    event.bookID = book.id;
+    event.copies = book.copies;
+    event.owned = book.owned;
+    BookHandle handle = findBookHandle(book.id);
+    if (resolveBook(handle)) event.category = bookSlab[handle.slot].category;
+    strncpy(event.text, book.title.c_str(), sizeof(event.text) - 1);
+    emitChange(event);
+}
+
+void emitBorrowerChange(uint8_t kind, const Borrower& borrower) {
+    if (!changeCapture.enabled) return;
+    ChangeEvent event = {};
+    event.kind = kind;
+    event.borrowerID = borrower.id;
+    strncpy(event.text, (borrower.firstName + " " + borrower.lastName).c_str(), sizeof(event.text) - 1);
+    emitChange(event);
+}
+
+// One JSONL record; fields that do not apply to the event's kind are left out
+string changeEventJson(const ChangeEvent& event) {
+    static const char* const KIND_NAMES[] = {"", "borrow", "return", "book_added", "book_changed", "book_removed",
+                                             "borrower_added", "borrower_changed", "borrower_removed"};
+    ostringstream out;
+    out << "{\"seq\":" << event.sequence << ",\"time_ms\":" << event.timeMs << ",\"type\":\"" << KIND_NAMES[event.kind] << "\"";
+    if (event.kind == CHANGE_BORROW || event.kind == CHANGE_RETURN) {
+        out << ",\"borrower\":" << event.borrowerID << ",\"book\":" << event.bookID
+            << ",\"borrowed\":\"" << dateFromDays(event.borrowDay) << "\"";
+        if (event.kind == CHANGE_RETURN) out << ",\"returned\":\"" << dateFromDays(event.returnDay) << "\",\"fee\":" << event.fee;
+    } else if (event.kind <= CHANGE_BOOK_REMOVED) {
+        out << ",\"book\":" << event.bookID;
+        if (event.kind != CHANGE_BOOK_REMOVED) {
+            out << ",\"category\":\"" << jsonEscape(CATEGORY_NAMES[event.category]) << "\",\"title\":\"" << jsonEscape(event.text)
+                << "\",\"copies\":" << event.copies;
+            if (event.owned >= 0) out << ",\"owned\":" << event.owned;
+        }
+    } else {
+        out << ",\"borrower\":" << event.borrowerID;
+        if (event.kind != CHANGE_BORROWER_REMOVED) out << ",\"name\":\"" << jsonEscape(event.text) << "\"";
+    }
+    out << "}\n";
+    return out.str();
+}
+
+// Opened without blocking, so a named pipe with no reader yet is retried later instead of
+// stalling the writer; once open, writes block as usual
+bool openChangeSink() {
+#ifdef _WIN32
+    changeCapture.sink.open(changeCapture.path, ios::app | ios::binary);
+    return changeCapture.sink.is_open();
+#else
+    changeCapture.fd = open(changeCapture.path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_NONBLOCK, 0644);
+    if (changeCapture.fd < 0) return false;
+    fcntl(changeCapture.fd, F_SETFL, fcntl(changeCapture.fd, F_GETFL) & ~O_NONBLOCK);
+    return true;
+#endif
+}
+
+void closeChangeSink() {
+#ifdef _WIN32
+    changeCapture.sink.close();
+    changeCapture.sink.clear();
+#else
+    if (changeCapture.fd >= 0) close(changeCapture.fd);
+    changeCapture.fd = -1;
+#endif
+}
+
+// Returns how many bytes reached the sink. Falling short means the sink is gone: a pipe whose
+// reader went away fails with EPIPE (SIGPIPE is blocked on the writer thread), a file with
+// the disk full with ENOSPC.
+size_t writeChangeBatch(const string& text) {
+#ifdef _WIN32
+    changeCapture.sink << text;
+    changeCapture.sink.flush();
+    return changeCapture.sink ? text.size() : 0;
+#else
+    size_t written = 0;
+    while (written < text.size()) {
+        ssize_t result = write(changeCapture.fd, text.data() + written, text.size() - written);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) break;
+        written += size_t(result);
+    }
+    return written;
+#endif
+}
+
+// Writer thread: drains the ring in batches, one write per batch, then records the last
+// sequence written so the numbering carries on after a restart. Events stay in the batch
+// until they have been written in full; when the sink goes away the rest wait for it to be
+// reopened and are sent again whole, so a reader may see the event it was cut off in twice.
+void writeChanges() {
+    nameTraceThread("change stream writer");
+#ifndef _WIN32
+    // A pipe whose reader left must fail the write with EPIPE, not kill the desk
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, nullptr);
+#endif
+    vector<ChangeEvent> batch;
+    bool open = false;
+    while (true) {
+        bool stopping = changeCapture.stopping.load();
+        if (!open) open = openChangeSink();
+        if (open && batch.size() < CHANGE_BATCH) changeCapture.ring.pop(batch, CHANGE_BATCH - batch.size());
+
+        if (open && !batch.empty()) {
+            string text;
+            vector<size_t> eventEnds;
+            for (const auto& event : batch) {
+                text += changeEventJson(event);
+                eventEnds.push_back(text.size());
+            }
+            size_t written = writeChangeBatch(text);
+            size_t complete = size_t(upper_bound(eventEnds.begin(), eventEnds.end(), written) - eventEnds.begin());
+            if (complete > 0) {
+                ofstream sequenceFile(changeCapture.path + CHANGE_SEQUENCE_SUFFIX, ios::trunc);
+                sequenceFile << batch[complete - 1].sequence << "\n";
+                batch.erase(batch.begin(), batch.begin() + complete);
+            }
+            if (batch.empty()) continue; // More may be waiting; sleep only once the ring is empty
+            closeChangeSink();
+            open = false;
+        } else if (batch.empty() && stopping) {
+            break;
+        }
+        if (stopping && !open) break; // The sink is gone and nothing will reopen it in time
+        this_thread::sleep_for(chrono::milliseconds(CHANGE_FLUSH_MS));
+    }
+    changeCapture.lost.fetch_add(batch.size(), memory_order_relaxed);
+    closeChangeSink();
+}
+
+void startChangeCapture() {
+    const char* path = getenv(CHANGE_STREAM_ENV.c_str());
+    if (!path || !*path) return;
+
+    changeCapture.path = path;
+    ifstream sequenceFile(changeCapture.path + CHANGE_SEQUENCE_SUFFIX);
+    uint64_t last = 0;
+    if (sequenceFile >> last) changeCapture.nextSequence = last + 1;
+    changeCapture.ring.slots.resize(ChangeRing::CAPACITY);
+    changeCapture.enabled = true;
+    changeCapture.writer = thread(writeChanges);
+}
+
+// Drains what is queued before returning; a pipe nobody opened by then cannot be drained
+void stopChangeCapture() {
+    if (!changeCapture.enabled) return;
+    changeCapture.stopping = true;
+    changeCapture.writer.join();
+    changeCapture.enabled = false;
+
+    uint64_t unsent = changeCapture.ring.head.load() - changeCapture.ring.tail.load();
+    uint64_t missed = unsent + changeCapture.dropped.load() + changeCapture.lost.load();
+    if (missed > 0) libraryNotice("\tChange stream: " + to_string(missed) + " events could not be written to " + changeCapture.path + ".\n");
+}
+
+string findBookTitle(int bookID) {
+    Book* book = resolveBook(findBookHandle(bookID));
+    return book ? book->title : "";
+}
+
+// Empty once the loaned book has been deleted
+string findBookTitle(const BorrowedBookDetails& loan) {
+    Book* book = resolveBook(loan.book);
+    return book ? book->title : "";
+}
+
+string lowercase(const string& text) {
+    string result = text;
+    for (auto& c : result) c = char(tolower((unsigned char)c));
+    return result;
+}
+
+// Loading appends every key unsorted and sorts once at the end; later inserts go through indexBorrowerName()
+array<NameKey, 2> nameKeysOf(const Borrower& borrower) {
+    return {NameKey{lowercase(borrower.lastName + " " + borrower.firstName), borrower.id},
+            NameKey{lowercase(borrower.firstName + " " + borrower.lastName), borrower.id}};
+}
+
+void appendNameKeys(const Borrower& borrower) {
+    for (const auto& key : nameKeysOf(borrower)) borrowerNameIndex.push_back(key);
+}
+
+void indexBorrowerName(const Borrower& borrower) {
+    for (const auto& key : nameKeysOf(borrower)) {
+        borrowerNameIndex.insert(upper_bound(borrowerNameIndex.begin(), borrowerNameIndex.end(), key), key);
+    }
+}
+
+void unindexBorrowerName(const Borrower& borrower) {
+    for (const auto& key : nameKeysOf(borrower)) {
+        auto it = lower_bound(borrowerNameIndex.begin(), borrowerNameIndex.end(), key);
+        if (it != borrowerNameIndex.end() && it->key == key.key && it->borrowerID == key.borrowerID) borrowerNameIndex.erase(it);
+    }
+}
+
+// Borrower IDs whose surname or first name starts with the prefix, at most limit of them
+vector<int> findBorrowersByName(const string& prefix, size_t limit) {
+    vector<int> matches;
+    string needle = lowercase(prefix);
+    auto it = lower_bound(borrowerNameIndex.begin(), borrowerNameIndex.end(), NameKey{needle, INT32_MIN});
+    for (; it != borrowerNameIndex.end() && matches.size() < limit; ++it) {
+        if (it->key.compare(0, needle.size(), needle) != 0) break;
+        if (find(matches.begin(), matches.end(), it->borrowerID) == matches.end()) {
+            matches.push_back(it->borrowerID);
+        }
+    }
+    return matches;
+}
+
+void rebuildTitleIndex() {
+    TraceSpan span("rebuildTitleIndex");
+    titleIndex.clear();
+    for (const auto& category : {&fictionBooks, &nonFictionBooks, &scienceBooks, &mysteryBooks, &romanceBooks,
+                                 &biographyBooks, &historyBooks, &technologyBooks, &childrenBooks, &artBooks}) {
+        for (const auto& book : *category) {
+            titleIndex.push_back({lowercase(book.title), book.id});
+        }
+    }
+    titleIndexDirty = false;
+}
+
+// Myers/Hyyro bit-parallel edit distance: the smallest number of edits that turns the
+// pattern into some substring of the text, one 64-bit step per text character
+int bestSubstringDistance(const uint64_t peq[256], int patternLength, const string& text) {
+    const uint64_t highBit = uint64_t(1) << (patternLength - 1);
+    uint64_t pv = ~uint64_t(0), mv = 0;
+    int score = patternLength, best = patternLength;
+
+    for (unsigned char c : text) {
+        uint64_t eq = peq[c];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if (ph & highBit) score++;
+        else if (mh & highBit) score--;
+        ph <<= 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        best = min(best, score);
+    }
+    return best;
+}
+
+// Top-k closest titles; each thread scans its own block of titleIndex and keeps a local top-k
+vector<TitleMatch> fuzzyTitleSearch(const string& query, size_t k) {
+    TraceSpan span("fuzzyTitleSearch");
+    if (titleIndexDirty) rebuildTitleIndex();
+
+    string pattern = lowercase(query).substr(0, 64); // One machine word per pattern
+    if (pattern.empty() || k == 0 || titleIndex.empty()) return {};
+    const int patternLength = int(pattern.size());
+    const int maxDistance = max(1, patternLength / 3);
+
+    uint64_t peq[256] = {0};
+    for (int i = 0; i < patternLength; ++i) {
+        peq[(unsigned char)pattern[i]] |= uint64_t(1) << i;
+    }
+
+    const size_t BLOCK_SIZE = 16384;
+    size_t threadCount = min<size_t>(max(1u, thread::hardware_concurrency()), (titleIndex.size() + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    vector<vector<TitleMatch>> partial(threadCount);
+
+    auto scan = [&](size_t worker) {
+        priority_queue<TitleMatch> best; // Worst kept match on top
+        for (size_t i = worker * BLOCK_SIZE; i < titleIndex.size(); i += threadCount * BLOCK_SIZE) {
+            size_t end = min(titleIndex.size(), i + BLOCK_SIZE);
+            for (size_t j = i; j < end; ++j) {
+                int distance = bestSubstringDistance(peq, patternLength, titleIndex[j].title);
+                if (distance > maxDistance) continue;
+                TitleMatch match{distance, abs(int(titleIndex[j].title.size()) - patternLength), titleIndex[j].bookID};
+                if (best.size() < k) best.push(match);
+                else if (match < best.top()) {
+                    best.pop();
+                    best.push(match);
+                }
+            }
+        }
+        for (; !best.empty(); best.pop()) partial[worker].push_back(best.top());
+    };
+
+    vector<thread> workers;
+    for (size_t worker = 1; worker < threadCount; ++worker) {
+        workers.emplace_back(scan, worker);
+    }
+    scan(0);
+    for (auto& worker : workers) worker.join();
+
+    vector<TitleMatch> matches;
+    for (const auto& list : partial) matches.insert(matches.end(), list.begin(), list.end());
+    size_t keep = min(k, matches.size());
+    partial_sort(matches.begin(), matches.begin() + keep, matches.end());
+    matches.resize(keep);
+    return matches;
+}
+
+// Splits a query into words, operators, commas and "quoted strings" (kept with their quotes)
+vector<string> tokenizeQuery(const string& text) {
+    vector<string> tokens;
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (isspace((unsigned char)c)) {
+            i++;
+        } else if (c == '"') {
+            size_t close = text.find('"', i + 1);
+            if (close == string::npos) close = text.size();
+            tokens.push_back(text.substr(i, close - i + 1));
+            i = close + 1;
+        } else if (c == ',') {
+            tokens.push_back(",");
+            i++;
+        } else if (c == '=' || c == '!' || c == '<' || c == '>') {
+            size_t length = (i + 1 < text.size() && text[i + 1] == '=') ? 2 : 1;
+            tokens.push_back(text.substr(i, length));
+            i += length;
+        } else {
+            size_t start = i;
+            while (i < text.size() && !isspace((unsigned char)text[i]) && string(",=!<>\"").find(text[i]) == string::npos) i++;
+            tokens.push_back(text.substr(start, i - start));
+        }
+    }
+    return tokens;
+}
+
+string unquote(const string& token) {
+    if (token.size() >= 2 && token.front() == '"' && token.back() == '"') return token.substr(1, token.size() - 2);
+    if (!token.empty() && token.front() == '"') return token.substr(1);
+    return token;
+}
+
+// Accepts the menu number or the category name, in any letter case
+int parseQueryCategory(const string& text) {
+    string name = lowercase(text);
+    for (int c = 0; c < 10; ++c) {
+        if (name == lowercase(CATEGORY_NAMES[c]) || name == to_string(c + 1)) return c;
+    }
+    return -1;
+}
+
+// Every numeric comparison narrows an inclusive range, so the scan only ever tests two bounds per column
+bool narrowRange(const string& op, int value, int32_t& low, int32_t& high) {
+    if (op == "=" || op == "==") { low = max(low, value); high = min(high, value); }
+    else if (op == "<") { high = min<int64_t>(high, int64_t(value) - 1); }
+    else if (op == "<=") { high = min(high, value); }
+    else if (op == ">") { low = max<int64_t>(low, int64_t(value) + 1); }
+    else if (op == ">=") { low = max(low, value); }
+    else return false;
+    return true;
+}
+
+// Grammar: [clause {and clause}] [sort [by] id|title|copies [asc|desc]] [limit N]
+//   clause: category in A, B, ... | category = A | id|copies <op> N | title contains X
+bool parseBookQuery(const string& text, BookQuery& query, string& error) {
+    vector<string> tokens = tokenizeQuery(text);
+    size_t pos = 0;
+    auto peek = [&]() { return pos < tokens.size() ? lowercase(tokens[pos]) : string(); };
+    auto next = [&]() { return pos < tokens.size() ? tokens[pos++] : string(); };
+
+    bool expectClause = true;
+    while (pos < tokens.size() && peek() != "sort" && peek() != "limit") {
+        if (!expectClause) {
+            if (next() != "and") { error = "Expected \"and\" between conditions."; return false; }
+            expectClause = true;
+            continue;
+        }
+        string field = lowercase(next());
+        if (field == "category") {
+            string op = lowercase(next());
+            if (op != "in" && op != "=" && op != "==") { error = "Use \"category in ...\" or \"category = ...\"."; return false; }
+            uint16_t mask = 0;
+            while (true) {
+                int category = parseQueryCategory(unquote(next()));
+                if (category < 0) { error = "Unknown category."; return false; }
+                mask |= uint16_t(1u << category);
+                if (op != "in" || peek() != ",") break;
+                pos++;
+            }
+            query.categories &= mask;
+        } else if (field == "id" || field == "copies") {
+            string op = next();
+            int value;
+            try {
+                value = stoi(next());
+            } catch (const exception& e) {
+                error = "Expected a number after " + field + " " + op + ".";
+                return false;
+            }
+            bool ok = field == "id" ? narrowRange(op, value, query.idLow, query.idHigh)
+                                    : narrowRange(op, value, query.copiesLow, query.copiesHigh);
+            if (!ok) { error = "Unknown comparison \"" + op + "\"."; return false; }
+        } else if (field == "title") {
+            if (lowercase(next()) != "contains") { error = "Use \"title contains ...\"."; return false; }
+            string needle = lowercase(unquote(next()));
+            if (!needle.empty()) query.titleContains.push_back(needle);
+        } else {
+            error = "Unknown field \"" + field + "\".";
+            return false;
+        }
+        expectClause = false;
+    }
+
+    if (peek() == "sort") {
+        pos++;
+        if (peek() == "by") pos++;
+        string field = lowercase(next());
+        if (field == "id") query.sortBy = BookQuery::BY_ID;
+        else if (field == "title") query.sortBy = BookQuery::BY_TITLE;
+        else if (field == "copies") query.sortBy = BookQuery::BY_COPIES;
+        else { error = "Sort by id, title or copies."; return false; }
+        if (peek() == "desc" || peek() == "asc") query.descending = lowercase(next()) == "desc";
+    }
+    if (peek() == "limit") {
+        pos++;
+        try {
+            query.limit = size_t(max(0, stoi(next())));
+        } catch (const exception& e) {
+            error = "Expected a number after limit.";
+            return false;
+        }
+    }
+    if (pos < tokens.size()) {
+        error = "Unexpected \"" + tokens[pos] + "\".";
+        return false;
+    }
+    return true;
+}
+
+// One category's scan: numeric columns are filtered a chunk at a time without branches,
+// and only the survivors have their titles checked
+void scanCategory(const vector<shared_ptr<const vector<Book>>>& chunks, uint8_t category,
+                  const BookQuery& query, vector<QueryRow>& rows) {
+    int32_t ids[SNAPSHOT_CHUNK], copies[SNAPSHOT_CHUNK];
+    uint16_t selection[SNAPSHOT_CHUNK];
+
+    for (const auto& chunk : chunks) {
+        const vector<Book>& books = *chunk;
+        size_t count = books.size();
+        for (size_t i = 0; i < count; ++i) {
+            ids[i] = books[i].id;
+            copies[i] = books[i].copies;
+        }
+
+        size_t selected = 0;
+        for (size_t i = 0; i < count; ++i) {
+            selection[selected] = uint16_t(i);
+            selected += (ids[i] >= query.idLow) & (ids[i] <= query.idHigh) &
+                        (copies[i] >= query.copiesLow) & (copies[i] <= query.copiesHigh);
+        }
+
+        for (size_t s = 0; s < selected; ++s) {
+            const Book& book = books[selection[s]];
+            bool matches = true;
+            if (!query.titleContains.empty()) {
+                string title = lowercase(book.title);
+                for (const auto& needle : query.titleContains) {
+                    if (title.find(needle) == string::npos) { matches = false; break; }
+                }
+            }
+            if (matches) rows.push_back({book, category});
+        }
+    }
+}
+
+// Runs against a pinned snapshot. Small catalogs are scanned on the calling thread; larger
+// ones get a thread per QUERY_BOOKS_PER_THREAD books, each taking whole categories.
+vector<QueryRow> runBookQuery(const BookQuery& query) {
+    TraceSpan span("runBookQuery");
+    shared_ptr<const LibrarySnapshot> snapshot = pinSnapshot();
+    vector<uint8_t> selected;
+    size_t books = 0;
+    for (uint8_t c = 0; c < 10; ++c) {
+        if (!(query.categories & (1u << c))) continue;
+        selected.push_back(c);
+        for (const auto& chunk : snapshot->categoryChunks[c]) books += chunk->size();
+    }
+
+    array<vector<QueryRow>, 10> partial;
+    size_t threadCount = min<size_t>({max(1u, thread::hardware_concurrency()), max<size_t>(1, selected.size()),
+                                      (books + QUERY_BOOKS_PER_THREAD - 1) / QUERY_BOOKS_PER_THREAD});
+    auto scan = [&](size_t worker) {
+        for (size_t i = worker; i < selected.size(); i += threadCount) {
+            uint8_t c = selected[i];
+            scanCategory(snapshot->categoryChunks[c], c, query, partial[c]);
+        }
+    };
+    vector<thread> workers;
+    for (size_t worker = 1; worker < threadCount; ++worker) workers.emplace_back(scan, worker);
+    scan(0);
+    for (auto& worker : workers) worker.join();
+
+    vector<QueryRow> rows;
+    for (auto& part : partial) rows.insert(rows.end(), part.begin(), part.end());
+
+    if (query.sortBy != BookQuery::UNSORTED) {
+        // Title keys are made once per row rather than once per comparison
+        vector<string> titleKeys;
+        if (query.sortBy == BookQuery::BY_TITLE) {
+            for (const auto& row : rows) titleKeys.push_back(titleSortKey(row.book.title));
+        }
+        vector<uint32_t> order(rows.size());
+        for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+        auto before = [&](uint32_t a, uint32_t b) {
+            uint32_t x = query.descending ? b : a;
+            uint32_t y = query.descending ? a : b;
+            if (query.sortBy == BookQuery::BY_TITLE && titleKeys[x] != titleKeys[y]) return titleKeys[x] < titleKeys[y];
+            if (query.sortBy == BookQuery::BY_COPIES && rows[x].book.copies != rows[y].book.copies) return rows[x].book.copies < rows[y].book.copies;
+            return rows[x].book.id < rows[y].book.id;
+        };
+        size_t kept = min(query.limit, rows.size());
+        partial_sort(order.begin(), order.begin() + kept, order.end(), before);
+
+        vector<QueryRow> sorted;
+        sorted.reserve(kept);
+        for (size_t i = 0; i < kept; ++i) sorted.push_back(rows[order[i]]);
+        return sorted;
+    }
+    if (query.limit < rows.size()) rows.resize(query.limit);
+    return rows;
+}
+
+bool ColumnarWriter::open(const string& path) {
+    out.open(path, ios::binary | ios::trunc);
+    if (!out.is_open()) return false;
+    out.write(COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+    position = sizeof(COLUMNAR_MAGIC);
+    return true;
+}
+
+// Every buffer starts on an 8-byte boundary so readers can map columns straight into typed arrays
+uint64_t ColumnarWriter::writeBlock(const void* data, size_t bytes) {
+    uint64_t offset = position;
+    out.write(static_cast<const char*>(data), streamsize(bytes));
+    position += bytes;
+    static const char padding[8] = {};
+    size_t pad = (8 - position % 8) % 8;
+    out.write(padding, streamsize(pad));
+    position += pad;
+    return offset;
+}
+
+void ColumnarWriter::writeStrings(ColumnSpec& column, const vector<string>& values) {
+    vector<int32_t> offsets(1, 0);
+    string data;
+    for (const auto& value : values) {
+        data += value;
+        offsets.push_back(int32_t(data.size()));
+    }
+    ColumnChunk chunk;
+    chunk.rows = uint32_t(values.size());
+    chunk.length = offsets.size() * sizeof(int32_t);
+    chunk.offset = writeBlock(offsets.data(), chunk.length);
+    chunk.dataLength = data.size();
+    chunk.dataOffset = writeBlock(data.data(), data.size());
+    column.chunks.push_back(chunk);
+}
+
+string jsonEscape(const string& text) {
+    string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        if ((unsigned char)c < 0x20) continue;
+        escaped += c;
+    }
+    return escaped;
+}
+
+// Footer: a JSON schema listing every column chunk, then its length and the magic again
+bool ColumnarWriter::finish(const vector<ColumnTable>& tables) {
+    ostringstream footer;
+    footer << "{\"version\":1,\"dictionaries\":{\"category\":[";
+    for (int c = 0; c < 10; ++c) footer << (c ? "," : "") << "\"" << jsonEscape(CATEGORY_NAMES[c]) << "\"";
+    footer << "]},\"tables\":[";
+    for (size_t t = 0; t < tables.size(); ++t) {
+        const ColumnTable& table = tables[t];
+        footer << (t ? "," : "") << "{\"name\":\"" << table.name << "\",\"rows\":" << table.rows << ",\"columns\":[";
+        for (size_t c = 0; c < table.columns.size(); ++c) {
+            const ColumnSpec& column = table.columns[c];
+            footer << (c ? "," : "") << "{\"name\":\"" << column.name << "\",\"type\":\"" << column.type << "\"";
+            if (!column.dictionary.empty()) footer << ",\"dictionary\":\"" << column.dictionary << "\"";
+            footer << ",\"chunks\":[";
+            for (size_t k = 0; k < column.chunks.size(); ++k) {
+                const ColumnChunk& chunk = column.chunks[k];
+                footer << (k ? "," : "") << "{\"rows\":" << chunk.rows << ",\"offset\":" << chunk.offset
+                       << ",\"length\":" << chunk.length;
+                if (column.type == "utf8") {
+                    footer << ",\"dataOffset\":" << chunk.dataOffset << ",\"dataLength\":" << chunk.dataLength;
+                }
+                footer << "}";
+            }
+            footer << "]}";
+        }
+        footer << "]}";
+    }
+    footer << "]}";
+
+    string text = footer.str();
+    uint64_t length = text.size();
+    out.write(text.data(), streamsize(text.size()));
+    out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.write(COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+    out.close();
+    return !out.fail();
+}
+
+// Books and loans go out one row group at a time, so memory stays at one group per table
+// however large the history is; in store mode borrowers are streamed from disk as well
+bool exportColumnar(const string& path, string& error) {
+    TraceSpan span("exportColumnar");
+    ColumnarWriter writer;
+    if (!writer.open(path)) {
+        error = "Cannot open " + path + " for writing.";
+        return false;
+    }
+
+    ColumnTable books{"books", 0, {{"id", "int32"}, {"copies", "int32"}, {"category", "uint8", "category"}, {"title", "utf8"}}};
+    vector<int32_t> ids, copies;
+    vector<uint8_t> categories;
+    vector<string> titles;
+    auto flushBooks = [&]() {
+        if (ids.empty()) return;
+        writer.writeColumn(books.columns[0], ids);
+        writer.writeColumn(books.columns[1], copies);
+        writer.writeColumn(books.columns[2], categories);
+        writer.writeStrings(books.columns[3], titles);
+        books.rows += ids.size();
+        ids.clear();
+        copies.clear();
+        categories.clear();
+        titles.clear();
+    };
+    for (uint8_t c = 0; c < 10; ++c) {
+        for (const auto& book : *categoryLists[c]) {
+            ids.push_back(book.id);
+            copies.push_back(book.copies);
+            categories.push_back(c);
+            titles.push_back(book.title);
+            if (ids.size() == EXPORT_ROW_GROUP) flushBooks();
+        }
+    }
+    flushBooks();
+
+    ColumnTable loans{"loans", 0, {{"borrowerId", "int32"}, {"bookId", "int32"}, {"borrowDay", "int32"},
+                                   {"returnDay", "int32"}, {"overdueFee", "int32"}}};
+    array<vector<int32_t>, 5> loanColumns;
+    auto flushLoans = [&]() {
+        if (loanColumns[0].empty()) return;
+        loans.rows += loanColumns[0].size();
+        for (size_t c = 0; c < loanColumns.size(); ++c) {
+            writer.writeColumn(loans.columns[c], loanColumns[c]);
+            loanColumns[c].clear();
+        }
+    };
+    forEachBorrower([&](const Borrower& borrower, const BorrowedBookDetails* loanBase) {
+        for (const auto& loan : loansOf(borrower, loanBase)) {
+            loanColumns[0].push_back(borrower.id);
+            loanColumns[1].push_back(loan.id);
+            loanColumns[2].push_back(loan.borrowDay);
+            loanColumns[3].push_back(loan.returnDay);
+            loanColumns[4].push_back(loan.overdueFee);
+            if (loanColumns[0].size() == EXPORT_ROW_GROUP) flushLoans();
+        }
+    });
+    flushLoans();
+
+    if (!writer.finish({books, loans})) {
+        error = "Writing " + path + " failed.";
+        return false;
+    }
+    return true;
+}
+
+// Counts each ID, so asking for the same book twice needs two copies (or two open loans)
+unordered_map<int, int> countBookIDs(const vector<int>& bookIDs) {
+    unordered_map<int, int> counts;
+    for (int id : bookIDs) counts[id]++;
+    return counts;
+}
+
+// Everything is checked before anything changes; on failure nothing is touched and error says why.
+// On success the copy counts reach books.dat in one flush and readers see one new snapshot.
+bool borrowBooks(int borrowerID, const vector<int>& bookIDs, const string& date, string& error) {
+    TraceSpan span("borrowBooks");
+    Borrower* borrower = findBorrower(borrowerID);
+    if (!borrower) { error = "Borrower ID not found."; return false; }
+    if (bookIDs.empty()) { error = "No book IDs given."; return false; }
+    if (!isValidDate(date)) { error = "Invalid date format. Please enter a valid date (YYYY-MM-DD)."; return false; }
+    if (borrowerStats[borrowerID].activeLoans + int(bookIDs.size()) > MAX_ACTIVE_LOANS) {
+        error = "A borrower may hold at most " + to_string(MAX_ACTIVE_LOANS) + " books at once.";
+        return false;
+    }
+    for (const auto& wanted : countBookIDs(bookIDs)) {
+        Book* book = resolveBook(findBookHandle(wanted.first));
+        if (!book) { error = "Book ID " + to_string(wanted.first) + " not found."; return false; }
+        if (book->copies < wanted.second) { error = "Not enough copies of book ID " + to_string(wanted.first) + "."; return false; }
+    }
+
+    int borrowDay = daysFromDate(date);
+    loanJournal.noteBorrow(borrowerID, date, bookIDs);
+    for (int id : bookIDs) {
+        BookHandle handle = findBookHandle(id);
+        Book& book = *resolveBook(handle);
+        appendLoan(*borrower, {book.id, borrowDay, NOT_RETURNED, 0, handle});
+        book.copies--;
+        recordBorrow(*borrower, book, date, false);
+    }
+    commitTransaction();
+    return true;
+}
+
+// Closes one open loan per listed ID; fees receives each loan's overdue fee in the same order
+bool returnBooks(int borrowerID, const vector<int>& bookIDs, const string& date, vector<int>& fees, string& error) {
+    TraceSpan span("returnBooks");
+    Borrower* borrower = findBorrower(borrowerID);
+    if (!borrower) { error = "Borrower ID not found."; return false; }
+    if (bookIDs.empty()) { error = "No book IDs given."; return false; }
+    if (!isValidDate(date)) { error = "Invalid date format. Please enter a valid date (YYYY-MM-DD)."; return false; }
+
+    unordered_map<int, int> wanted = countBookIDs(bookIDs);
+    for (const auto& loan : loansOf(*borrower)) {
+        auto it = wanted.find(loan.id);
+        if (it != wanted.end() && loan.returnDay == NOT_RETURNED) it->second--;
+    }
+    for (const auto& remaining : wanted) {
+        if (remaining.second > 0) {
+            error = "Borrower has no open loan for book ID " + to_string(remaining.first) + ".";
+            return false;
+        }
+    }
+
+    int returnDay = daysFromDate(date);
+    fees.clear();
+    for (int id : bookIDs) {
+        BorrowedBookDetails& loan = *findOpenLoan(*borrower, id);
+        int overdueFee = calculateOverdueFee(loan.book, loan.borrowDay, returnDay);
+        loan.returnDay = returnDay;
+        loan.overdueFee = overdueFee;
+        recordReturn(*borrower, id, loan.borrowDay, returnDay, overdueFee);
+        fees.push_back(overdueFee);
+
+        if (Book* book = resolveBook(loan.book)) {
+            book->copies++;
+            markBookChanged(*book);
+            bookRecords.storeCopies(bookSlab[loan.book.slot], false);
+        }
+    }
+    loanJournal.noteReturn(borrowerID, date, bookIDs, fees);
+    commitTransaction();
+    return true;
+}
+
+// A loans.log line: "B,<borrower>,<date>,<book>..." or "R,<borrower>,<date>,<book>:<fee>...".
+// Books deleted since, or loans already closed, are passed over.
+bool replayLoanLine(const string& line, bool adjustCopies) {
+    istringstream fields(line);
+    string kind, borrowerField, date, item;
+    getline(fields, kind, ',');
+    getline(fields, borrowerField, ',');
+    getline(fields, date, ',');
+    Borrower* borrower = findBorrower(atoi(borrowerField.c_str()));
+    if (!borrower || !isValidDate(date) || (kind != "B" && kind != "R")) return false;
+
+    int day = daysFromDate(date);
+    while (getline(fields, item, ',')) {
+        int bookID = atoi(item.c_str());
+        if (kind == "B") {
+            BookHandle handle = findBookHandle(bookID);
+            Book* book = resolveBook(handle);
+            if (!book) continue;
+            appendLoan(*borrower, {bookID, day, NOT_RETURNED, 0, handle});
+            if (adjustCopies) book->copies--;
+            recordBorrow(*borrower, *book, date, false);
+        } else {
+            BorrowedBookDetails* loan = findOpenLoan(*borrower, bookID);
+            if (!loan) continue;
+            size_t colon = item.find(':');
+            int overdueFee = colon == string::npos ? 0 : atoi(item.c_str() + colon + 1);
+            loan->returnDay = day;
+            loan->overdueFee = overdueFee;
+            recordReturn(*borrower, bookID, loan->borrowDay, day, overdueFee);
+            Book* book = resolveBook(loan->book);
+            if (book && adjustCopies) {
+                book->copies++;
+                markBookChanged(*book);
+                bookRecords.storeCopies(bookSlab[loan->book.slot], false);
+            }
+        }
+    }
+    return true;
+}
+
+// The single commit point for a batch: one journal append, one books.dat flush, one borrower
+// write-back, one snapshot
+void commitTransaction() {
+    loanJournal.commit();
+    bookRecords.commit();
+    if (borrowerStore.enabled()) borrowerStore.flush();
+    publishSnapshot();
+}
+
+int daysSinceStartOfYear(int year, int month, int day) {
+    static const int daysInMonth[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int totalDays = 0;
+
+    // Add days of months in the same year
+    for (int i = 0; i < month - 1; ++i) {
+        totalDays += daysInMonth[i];
+    }
+
+    // Add the current month's days
+    totalDays += day;
+
+    // Handle leap years for February
+    if (month > 2 && ((year % 4 == 0 && year % 100 != 0) || (year % 400 == 0))) {
+        totalDays += 1; // Leap day
+    }
+
+    return totalDays;
+}
+
+// Leap years in [1900, year), so consecutive dates always map to consecutive day numbers
+int leapYearsBefore(int year) {
+    int y = year - 1;
+    return (y / 4 - y / 100 + y / 400) - (1899 / 4 - 1899 / 100 + 1899 / 400);
+}
+
+int daysFromDate(const string& date) {
+    int year = 1900, month = 1, day = 1;
+    sscanf(date.c_str(), "%d-%d-%d", &year, &month, &day);
+
+    // Calculate total days since 1900-01-01
+    int totalDays = (year - 1900) * 365 + leapYearsBefore(year);
+    totalDays += daysSinceStartOfYear(year, month, day);
+    return totalDays;
+}
+
+// Inverse of daysFromDate()
+string dateFromDays(int days) {
+    int year = 1900 + days / 366;
+    while ((year + 1 - 1900) * 365 + leapYearsBefore(year + 1) < days) {
+        year++;
+    }
+    int dayOfYear = days - ((year - 1900) * 365 + leapYearsBefore(year));
+
+    int month = 1;
+    while (month < 12 && daysSinceStartOfYear(year, month + 1, 1) <= dayOfYear) {
+        month++;
+    }
+    int day = dayOfYear - daysSinceStartOfYear(year, month, 1) + 1;
+
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d", year, month, day);
+    return buffer;
+}
+
+int calculateOverdueFee(BookHandle book, int borrowDay, int returnDay) {
+    return feeRuleFor(book).fee(borrowDay, returnDay);
+}
+
+// Groups the loans by category so each rule runs once over a contiguous batch
+vector<int> assessOverdueFees(const vector<DueEntry>& entries, int asOfDay) {
+    array<vector<int>, 10> borrowDays;
+    array<vector<size_t>, 10> positions;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        BookHandle book = findBookHandle(entries[i].bookID);
+        size_t category = resolveBook(book) ? bookSlab[book.slot].category : 0;
+        borrowDays[category].push_back(entries[i].borrowDay);
+        positions[category].push_back(i);
+    }
+
+    vector<int> fees(entries.size());
+    vector<int> batch;
+    for (size_t c = 0; c < 10; ++c) {
+        batch.resize(borrowDays[c].size());
+        categoryFeeRules[c].assess(borrowDays[c].data(), batch.size(), asOfDay, batch.data());
+        for (size_t i = 0; i < batch.size(); ++i) fees[positions[c][i]] = batch[i];
+    }
+    return fees;
+}
+
+// Loads the catalog and borrowers, from the shared catalog when another terminal already holds them
+void openLibrary() {
+    const char* tracePath = getenv(TRACE_ENV.c_str());
+    if (tracePath && *tracePath) startTracing(tracePath);
+    TraceSpan span("openLibrary");
+
+    const char* sharedName = getenv(SHARED_CATALOG_ENV.c_str());
+    if (sharedName && *sharedName && !sharedCatalog.open(sharedName)) {
+        libraryNotice("Error opening the shared catalog. Keeping a private copy of the data.\n");
+    }
+    if (sharedCatalog.enabled() && !sharedCatalog.created) {
+        loadSharedCatalog(); // Another terminal already has everything in memory
+    } else {
+        loadBooks();
+        bool copiesFromRecords = loadBookRecords();
+        loadBorrowers();
+        replayLoanJournal(!copiesFromRecords);
+        populateSharedCatalog();
+    }
+    publishSnapshot();
+    buildCoBorrowIndex();
+}
+
+// Writes books.txt and borrowers.txt, including what other terminals have changed
+LibraryStatus saveLibrary() {
+    TraceSpan span("saveLibrary");
+    LibraryStatus status;
+    applyPendingReloads();
+    if (sharedCatalog.enabled()) {
+        sharedCatalog.lock();
+        int32_t ahead = sharedCatalog.terminalWithUnshared();
+        sharedCatalog.unlock();
+        if (ahead != 0) {
+            status.error = "Terminal " + to_string(ahead) + " has changes the shared catalog had no room for; save from that terminal so they are not overwritten.";
+            libraryNotice("Error: " + status.error + "\n");
+            return status;
+        }
+    }
+    // Borrowers first: until books.txt is written too, books.dat still follows the old one and
+    // counts the loans the new borrowers.txt holds, so a crash in between loses nothing
+    bool borrowersSaved = saveBorrowers();
+    bool booksSaved = saveBooks();
+    status.ok = booksSaved && borrowersSaved;
+    if (!status.ok) status.error = "Not every data file could be written.";
+    return status;
+}
+
+// Stops the background threads and leaves the shared catalog; does not save. The timeline,
+// when one is being recorded, is written last so it includes the threads' final spans.
+void closeLibrary() {
+    stopFileWatcher();
+    stopChangeCapture();
+    sharedCatalog.leave();
+    if (traceLog.enabled && !traceLog.path.empty()) {
+        string error;
+        if (writeTrace(traceLog.path, error)) libraryNotice("Timeline written to " + traceLog.path + ".\n");
+        else libraryNotice(error + "\n");
+    }
+}
+
+BookResult findBook(int bookID) {
+    BookResult result;
+    BookHandle handle = findBookHandle(bookID);
+    Book* book = resolveBook(handle);
+    if (!book) {
+        result.error = "Book ID not found.";
+        return result;
+    }
+    result.ok = true;
+    result.book = *book;
+    result.category = bookSlab[handle.slot].category;
+    auto stats = bookStats.find(bookID);
+    if (stats != bookStats.end()) {
+        result.timesBorrowed = stats->second.timesBorrowed;
+        result.onLoan = stats->second.currentlyOut;
+    }
+    return result;
+}
+
+// Lowest ID no book has, offered when adding one
+int nextBookID() {
+    return uniqueBookIDs.nextFree();
+}
+
+bool bookIDInUse(int bookID) {
+    return uniqueBookIDs.contains(bookID);
+}
+
+// A book with no owned count is taken to own just the copies it starts with
+BookResult addBookToCatalog(uint8_t category, const Book& book) {
+    BookResult result;
+    if (category >= 10) {
+        result.error = "Invalid category. Book not added.";
+        return result;
+    }
+    if (book.id < 1) {
+        result.error = "Invalid Book ID. Please enter a positive number.";
+        return result;
+    }
+    if (uniqueBookIDs.contains(book.id)) {
+        result.error = "Error: Book ID must be unique. Book not added.";
+        return result;
+    }
+
+    Book added = book;
+    if (added.owned < 0) added.owned = added.copies;
+    BookHandle handle = categoryLists[category]->push_back(added);
+    uniqueBookIDs.insert(added.id);
+    noteSharedChange(SHARED_BOOK, added.id);
+    emitBookChange(CHANGE_BOOK_ADDED, added);
+    bookRecords.store(bookSlab[handle.slot]);
+    linkSortOrders(handle.slot);
+    titleIndexDirty = true;
+    publishSnapshot(); // A push_back only grows the last chunk, which publishing detects
+    return findBook(added.id);
+}
+
+// Replaces the title and available copies of the book with the same ID. A new copy count is a
+// recount, so the owned count becomes it plus whatever is on loan.
+BookResult updateBook(const Book& book) {
+    BookHandle handle = findBookHandle(book.id);
+    Book* current = resolveBook(handle);
+    if (!current) return findBook(book.id);
+
+    if (current->title != book.title) titleIndexDirty = true;
+    if (current->copies != book.copies) current->owned = book.copies + bookStats[book.id].currentlyOut;
+    current->title = book.title;
+    current->copies = book.copies;
+    markBookChanged(*current);
+    emitBookChange(CHANGE_BOOK_CHANGED, *current);
+    bookRecords.store(bookSlab[handle.slot]);
+    publishSnapshot();
+    return findBook(book.id);
+}
+
+LibraryStatus removeBookFromCatalog(int bookID) {
+    LibraryStatus status;
+    BookHandle handle = findBookHandle(bookID);
+    if (!resolveBook(handle)) {
+        status.error = "Book ID not found.";
+        return status;
+    }
+    auto stats = bookStats.find(bookID);
+    if (stats != bookStats.end() && stats->second.currentlyOut > 0) {
+        status.error = "This book cannot be deleted while " + to_string(stats->second.currentlyOut) + " copies are on loan.";
+        return status;
+    }
+    removeBook(handle);
+    publishSnapshot();
+    status.ok = true;
+    return status;
+}
+
+LoanInfo loanInfo(const BorrowedBookDetails& loan) {
+    return {loan.id, findBookTitle(loan), dateFromDays(loan.borrowDay), returnDateText(loan), loan.overdueFee};
+}
+
+// Rows [first, first + count) of a category's order, or the whole catalog's for ALL_CATEGORIES
+BookPage sortedBooks(uint8_t category, BookOrder order, size_t first, size_t count) {
+    BookPage page;
+    if (category > ALL_CATEGORIES) return page;
+    const SortOrders& orders = category == ALL_CATEGORIES ? catalogSortOrders : categorySortOrders[category];
+    const vector<uint32_t>& slots = order == ORDER_BY_TITLE ? orders.byTitle : order == ORDER_BY_ID ? orders.byID : orders.byCopies;
+    page.total = slots.size();
+    page.books = sortedPage(slots, first, count);
+    return page;
+}
+
+BorrowerResult findBorrowerRecord(int borrowerID) {
+    BorrowerResult result;
+    Borrower* borrower = findBorrower(borrowerID);
+    if (!borrower) {
+        result.error = "Borrower ID not found.";
+        return result;
+    }
+    result.ok = true;
+    result.borrower = *borrower;
+    for (const auto& loan : loansOf(*borrower)) result.loans.push_back(loanInfo(loan));
+    auto stats = borrowerStats.find(borrowerID);
+    if (stats != borrowerStats.end()) {
+        result.activeLoans = stats->second.activeLoans;
+        result.lifetimeFees = stats->second.lifetimeFees;
+    }
+    return result;
+}
+
+int nextBorrowerID() {
+    return uniqueBorrowerIDs.nextFree();
+}
+
+bool borrowerIDInUse(int borrowerID) {
+    return uniqueBorrowerIDs.contains(borrowerID);
+}
+
+// Borrowers whose surname or first name starts with the prefix
+vector<BorrowerSummary> searchBorrowerNames(const string& prefix, size_t limit) {
+    vector<BorrowerSummary> matches;
+    if (prefix.empty()) return matches;
+    for (int borrowerID : findBorrowersByName(prefix, limit)) {
+        const Borrower* borrower = findBorrower(borrowerID);
+        if (!borrower) continue;
+        BorrowerSummary summary;
+        summary.borrower = *borrower;
+        auto stats = borrowerStats.find(borrowerID);
+        if (stats != borrowerStats.end()) {
+            summary.activeLoans = stats->second.activeLoans;
+            summary.lifetimeFees = stats->second.lifetimeFees;
+        }
+        matches.push_back(summary);
+    }
+    return matches;
+}
+
+// Only the ID and names are taken; a new borrower starts with no loans
+BorrowerResult addBorrowerRecord(const BorrowerInfo& borrower) {
+    BorrowerResult result;
+    if (borrower.id < 1) {
+        result.error = "Invalid Borrower ID. Please enter a positive number.";
+        return result;
+    }
+    if (uniqueBorrowerIDs.contains(borrower.id)) {
+        result.error = "Error: Borrower ID must be unique. Borrower not added.";
+        return result;
+    }
+
+    Borrower added;
+    added.id = borrower.id;
+    added.lastName = borrower.lastName;
+    added.firstName = borrower.firstName;
+    added.middleInitial = borrower.middleInitial;
+    if (borrowerStore.enabled()) {
+        borrowerStore.insert(added);
+    } else {
+        borrowers.push_back(added);
+    }
+    uniqueBorrowerIDs.insert(added.id);
+    noteSharedChange(SHARED_BORROWER, added.id);
+    emitBorrowerChange(CHANGE_BORROWER_ADDED, added);
+    indexBorrowerName(added);
+    publishSnapshot();
+    return findBorrowerRecord(added.id);
+}
+
+// The loans a checkout or return just left behind, matched to the requested books by day
+vector<LoanInfo> loansTouched(int borrowerID, const vector<int>& bookIDs, const string& date, bool returned) {
+    vector<LoanInfo> touched;
+    Borrower* borrower = findBorrower(borrowerID);
+    if (!borrower) return touched;
+    int day = daysFromDate(date);
+    vector<const BorrowedBookDetails*> taken; // A book requested twice matches two loans
+    for (int bookID : bookIDs) {
+        const BorrowedBookDetails* match = nullptr;
+        for (const auto& loan : loansOf(*borrower)) {
+            bool sameDay = returned ? loan.returnDay == day : loan.borrowDay == day && loan.returnDay == NOT_RETURNED;
+            if (loan.id == bookID && sameDay && find(taken.begin(), taken.end(), &loan) == taken.end()) match = &loan;
+        }
+        if (!match) continue;
+        taken.push_back(match);
+        touched.push_back(loanInfo(*match));
+    }
+    return touched;
+}
+
+LoanResult checkOut(int borrowerID, const vector<int>& bookIDs, const string& date) {
+    LoanResult result;
+    result.ok = borrowBooks(borrowerID, bookIDs, date, result.error);
+    if (result.ok) result.loans = loansTouched(borrowerID, bookIDs, date, false);
+    return result;
+}
+
+LoanResult checkIn(int borrowerID, const vector<int>& bookIDs, const string& date) {
+    LoanResult result;
+    result.ok = returnBooks(borrowerID, bookIDs, date, result.fees, result.error);
+    if (result.ok) result.loans = loansTouched(borrowerID, bookIDs, date, true);
+    return result;
+}
+
+// Open loans whose due date is before the given date, with what each would owe if returned then
+OverdueResult overdueLoans(const string& date) {
+    OverdueResult result;
+    if (!isValidDate(date)) {
+        result.error = "Invalid date format. Please enter a valid date (YYYY-MM-DD).";
+        return result;
+    }
+    int today = daysFromDate(date);
+
+    // Every bucket before today holds loans that are already late; only those buckets are visited
+    vector<DueEntry> overdue;
+    for (auto bucket = dueWheel.begin(); bucket != dueWheel.end() && bucket->first < today; ++bucket) {
+        overdue.insert(overdue.end(), bucket->second.begin(), bucket->second.end());
+    }
+    vector<int> fees = assessOverdueFees(overdue, today);
+    for (size_t i = 0; i < overdue.size(); ++i) {
+        const DueEntry& entry = overdue[i];
+        result.loans.push_back({entry.borrowerID, entry.bookID, findBookTitle(entry.bookID), dateFromDays(entry.borrowDay),
+                                dateFromDays(entry.dueDay), today - entry.dueDay, fees[i]});
+    }
+    result.dueToday = loansDueOn(today).size();
+    result.ok = true;
+    return result;
+}
+
+LoanSpanResult loanSpans(const string& firstDate, const string& lastDate, vector<LoanInterval> (*search)(int firstDay, int lastDay)) {
+    LoanSpanResult result;
+    if (!isValidDate(firstDate) || !isValidDate(lastDate)) {
+        result.error = "Invalid date. Please enter valid dates (YYYY-MM-DD).";
+        return result;
+    }
+    for (const auto& loan : search(daysFromDate(firstDate), daysFromDate(lastDate))) {
+        result.loans.push_back({loan.borrowerID, loan.bookID, findBookTitle(loan.bookID), dateFromDays(loan.borrowDay),
+                                loan.endDay == OPEN_INTERVAL ? "" : dateFromDays(loan.endDay)});
+    }
+    result.ok = true;
+    return result;
+}
+
+// Loans borrowed on a day in [firstDate, lastDate]
+LoanSpanResult loansBorrowedInRange(const string& firstDate, const string& lastDate) {
+    return loanSpans(firstDate, lastDate, loansBorrowedBetween);
+}
+
+// Loans out on at least one day in [firstDate, lastDate]
+LoanSpanResult loansOutInRange(const string& firstDate, const string& lastDate) {
+    return loanSpans(firstDate, lastDate, loansOutDuring);
+}
+
+// Same query language as the Query Books screen and --query
+SearchResult searchCatalog(const string& query) {
+    SearchResult result;
+    BookQuery parsed;
+    if (!parseBookQuery(query, parsed, result.error)) return result;
+    result.rows = runBookQuery(parsed);
+    result.ok = true;
+    return result;
+}
+
+// Closest titles first, tolerating typos
+SearchResult searchTitles(const string& title, size_t limit) {
+    SearchResult result;
+    for (const auto& match : fuzzyTitleSearch(title, limit)) {
+        BookResult found = findBook(match.bookID);
+        if (!found.ok) continue;
+        result.rows.push_back({found.book, found.category});
+        result.distances.push_back(match.distance);
+    }
+    result.ok = true;
+    return result;
+}
+
+// Books most often found in the same borrowers' histories as this one, strongest first
+SearchResult patronsAlsoBorrowed(int bookID) {
+    SearchResult result;
+    for (const auto& neighbour : alsoBorrowed(bookID)) {
+        BookResult found = findBook(neighbour.bookID);
+        if (found.ok) result.rows.push_back({found.book, found.category}); // Skips books since deleted
+    }
+    result.ok = true;
+    return result;
+}
+
+bool categoryEmpty(const LibrarySnapshot& snapshot, uint8_t category) {
+    return category >= 10 || snapshot.categoryChunks[category].empty();
+}
+
+uint64_t categoryVersion(const LibrarySnapshot& snapshot, uint8_t category) {
+    return category < 10 ? snapshot.categoryVersions[category] : 0;
+}
+
+// A category's books in shelf order, a chunk at a time
+void forEachBookChunk(const LibrarySnapshot& snapshot, uint8_t category, const function<void(const vector<Book>&)>& fn) {
+    if (category >= 10) return;
+    for (const auto& chunk : snapshot.categoryChunks[category]) fn(*chunk);
+}
+
+bool borrowersEmpty(const LibrarySnapshot& snapshot) {
+    return borrowerStore.enabled() ? borrowerStore.order.empty() : snapshot.borrowerChunks.empty();
+}
+
+// Disk-resident borrowers are not in the snapshot, so they are streamed from the store instead
+void forEachBorrowerRow(const LibrarySnapshot& snapshot,
+                        const function<void(const BorrowerInfo&, uint64_t version, const function<vector<LoanInfo>()>& loans)>& fn) {
+    auto visit = [&fn](const Borrower& borrower, const BorrowedBookDetails* loanBase, uint64_t version) {
+        fn(borrower, version, [&borrower, loanBase]() {
+            vector<LoanInfo> loans;
+            for (const auto& loan : loansOf(borrower, loanBase)) loans.push_back(loanInfo(loan));
+            return loans;
+        });
+    };
+    if (borrowerStore.enabled()) {
+        forEachBorrower([&visit](const Borrower& borrower, const BorrowedBookDetails* loanBase) {
+            visit(borrower, loanBase, borrowerVersion(borrower.id));
+        });
+        return;
+    }
+    for (const auto& chunk : snapshot.borrowerChunks) {
+        for (size_t i = 0; i < chunk->borrowers.size(); ++i) {
+            visit(chunk->borrowers[i], chunk->loans.data(), chunk->versions[i]);
+        }
+    }
+}
+
+uint64_t titlesVersion() {
+    return titleVersion;
+}
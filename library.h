@@ -0,0 +1,221 @@
+// Library core: the catalog, borrowers, loans and every index over them. It reads no input
+// and writes nothing to the terminal; main.cpp is the interactive frontend. This file is the
+// whole API, for the frontend and for programs that embed the library. None of the calls
+// prompts or prints: each returns a result, and anything worth telling the user is left in
+// takeLibraryNotices(). Calls must come from one thread at a time. The data structures behind
+// them are in library_internal.h.
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct Book {
+    int id;
+    std::string title;
+    int copies;        // Available on the shelf
+    int owned = -1;    // Held by the library, on the shelf or on loan; -1 until known
+
+    // Define an equality operator to compare books by their ID
+    bool operator == (const Book& other) const {
+        return id == other.id;
+    }
+};
+
+struct BorrowerInfo {
+    int id = 0;
+    std::string lastName, firstName, middleInitial;
+};
+
+// A loan with its title and dates already resolved
+struct LoanInfo {
+    int bookID = 0;
+    std::string title;
+    std::string borrowDate;
+    std::string returnDate;        // Empty while the book is still out
+    int overdueFee = 0;
+};
+
+// A loan found by a date-range search
+struct LoanSpan {
+    int borrowerID = 0;
+    int bookID = 0;
+    std::string title;
+    std::string borrowDate;
+    std::string returnDate;        // Empty while the book is still out
+};
+
+struct OverdueLoan {
+    int borrowerID = 0;
+    int bookID = 0;
+    std::string title;
+    std::string borrowDate;
+    std::string dueDate;
+    int daysLate = 0;
+    int fee = 0;                   // Owed if the book came back on the report date
+};
+
+struct QueryRow {
+    Book book;
+    std::uint8_t category;
+};
+
+// Findings of reconcileInventory(): every book's owned copies should equal available plus on loan
+struct InventoryDrift {
+    int bookID;
+    int owned, available, onLoan;
+};
+
+struct DanglingLoan {
+    int borrowerID;
+    int bookID;
+    std::string borrowDate;
+};
+
+struct DuplicateBookID {
+    int bookID;
+    std::vector<std::uint8_t> categories;  // Each list the ID was filed in
+};
+
+struct InventoryReport {
+    std::vector<InventoryDrift> drift;
+    std::vector<DanglingLoan> dangling;
+    std::vector<DuplicateBookID> duplicates;
+    std::size_t booksChecked = 0, loansChecked = 0;
+    std::size_t baselined = 0;     // Books that had no owned count yet
+
+    bool clean() const { return drift.empty() && dangling.empty() && duplicates.empty(); }
+};
+
+// Immutable, versioned view of the catalog and borrowers; see pinSnapshot()
+struct LibrarySnapshot;
+
+// Orders sortedBooks() can page through without sorting
+enum BookOrder { ORDER_BY_TITLE, ORDER_BY_ID, ORDER_BY_COPIES };
+
+const std::uint8_t ALL_CATEGORIES = 10; // sortedBooks(): the whole catalog rather than one category
+const int MAX_ACTIVE_LOANS = 5; // Books a borrower may hold at once
+const std::string COLUMNAR_EXPORT_FILE = "library.col";
+const std::string CATEGORY_NAMES[10] = {"Fiction", "Non-Fiction", "Science Fiction & Fantasy", "Mystery & Thriller", "Romance",
+                                        "Biography & Autobiography", "History", "Science & Technology", "Children's Book", "Art & Design"};
+const std::string CATEGORY_FILE_NAMES[10] = {"Fiction", "NonFiction", "Science Fiction & Fantasy", "Mystery & Thriller", "Romance",
+                                             "Biography & Autobiography", "History", "Science & Technology", "Children's Book", "Art & Design"};
+
+struct LibraryStatus {
+    bool ok = false;
+    std::string error;
+};
+
+struct BookResult {
+    bool ok = false;
+    std::string error;
+    Book book;
+    std::uint8_t category = 0;     // Index into CATEGORY_NAMES
+    int timesBorrowed = 0;
+    int onLoan = 0;
+};
+
+struct BorrowerResult {
+    bool ok = false;
+    std::string error;
+    BorrowerInfo borrower;
+    std::vector<LoanInfo> loans;   // Oldest first
+    int activeLoans = 0;
+    long long lifetimeFees = 0;
+};
+
+struct BorrowerSummary {
+    BorrowerInfo borrower;
+    int activeLoans = 0;
+    long long lifetimeFees = 0;
+};
+
+struct LoanResult {
+    bool ok = false;
+    std::string error;
+    std::vector<int> fees;         // checkIn() only: each loan's overdue fee, in request order
+    std::vector<LoanInfo> loans;   // Each loan as the call left it, in request order
+};
+
+struct SearchResult {
+    bool ok = false;
+    std::string error;
+    std::vector<QueryRow> rows;
+    std::vector<int> distances;    // searchTitles() only: edits between the query and each row's title
+};
+
+struct LoanSpanResult {
+    bool ok = false;
+    std::string error;
+    std::vector<LoanSpan> loans;   // By borrow date
+};
+
+struct OverdueResult {
+    bool ok = false;
+    std::string error;
+    std::vector<OverdueLoan> loans; // Longest overdue first
+    std::size_t dueToday = 0;       // Loans that fall due on the report date itself
+};
+
+// One page of a maintained sort order
+struct BookPage {
+    std::vector<Book> books;
+    std::size_t total = 0;          // Books in the whole order
+};
+
+void libraryNotice(const std::string& text);
+std::vector<std::string> takeLibraryNotices();
+void openLibrary();
+LibraryStatus saveLibrary();
+void closeLibrary();
+void startChangeCapture();
+void startFileWatcher();
+std::string applyPendingReloads();
+bool isValidDate(const std::string& date);
+
+BookResult findBook(int bookID);
+std::string findBookTitle(int bookID);
+int nextBookID();
+bool bookIDInUse(int bookID);
+BookResult addBookToCatalog(std::uint8_t category, const Book& book);
+BookResult updateBook(const Book& book);
+LibraryStatus removeBookFromCatalog(int bookID);
+BookPage sortedBooks(std::uint8_t category, BookOrder order, std::size_t first, std::size_t count);
+
+BorrowerResult findBorrowerRecord(int borrowerID);
+int nextBorrowerID();
+bool borrowerIDInUse(int borrowerID);
+BorrowerResult addBorrowerRecord(const BorrowerInfo& borrower);
+std::vector<BorrowerSummary> searchBorrowerNames(const std::string& prefix, std::size_t limit);
+
+LoanResult checkOut(int borrowerID, const std::vector<int>& bookIDs, const std::string& date);
+LoanResult checkIn(int borrowerID, const std::vector<int>& bookIDs, const std::string& date);
+OverdueResult overdueLoans(const std::string& date);
+LoanSpanResult loansBorrowedInRange(const std::string& firstDate, const std::string& lastDate);
+LoanSpanResult loansOutInRange(const std::string& firstDate, const std::string& lastDate);
+
+SearchResult searchCatalog(const std::string& query);
+SearchResult searchTitles(const std::string& title, std::size_t limit);
+SearchResult patronsAlsoBorrowed(int bookID);
+bool exportColumnar(const std::string& path, std::string& error);
+InventoryReport reconcileInventory();
+
+// Listings read a pinned snapshot, so borrows and returns can go on while one is on screen.
+// Each category and borrower carries a version that changes whenever what it shows changes,
+// and titlesVersion() moves whenever any book title does, so a frontend can keep what it
+// rendered until then. A borrower's loans are only looked up when the listing asks for them.
+std::shared_ptr<const LibrarySnapshot> pinSnapshot();
+bool categoryEmpty(const LibrarySnapshot& snapshot, std::uint8_t category);
+std::uint64_t categoryVersion(const LibrarySnapshot& snapshot, std::uint8_t category);
+void forEachBookChunk(const LibrarySnapshot& snapshot, std::uint8_t category, const std::function<void(const std::vector<Book>&)>& fn);
+bool borrowersEmpty(const LibrarySnapshot& snapshot);
+void forEachBorrowerRow(const LibrarySnapshot& snapshot,
+                        const std::function<void(const BorrowerInfo&, std::uint64_t version, const std::function<std::vector<LoanInfo>()>& loans)>& fn);
+std::uint64_t borrowerVersion(int borrowerID);
+std::uint64_t titlesVersion();
+
+#endif
@@ -0,0 +1,1044 @@
+// Library core internals: the records, indexes and background machinery behind the API in
+// library.h. Only library.cpp includes this; frontends and embedding programs use library.h.
+#ifndef LIBRARY_INTERNAL_H
+#define LIBRARY_INTERNAL_H
+
+#include "library.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <iomanip>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <fstream>
+#include <unordered_map>
+#include <map>
+#include <tuple>
+#include <cctype>
+#include <set>
+#include <thread>
+#include <queue>
+#include <memory>
+#include <mutex>
+#include <array>
+#include <list>
+#include <cstdlib>
+#include <deque>
+#include <cstring>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <cerrno>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <iterator>
+
+using namespace std;
+
+// Refers to a book by its slab slot; stops resolving once that book is deleted
+struct BookHandle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+// A deleted slot bumps its generation and joins the free list
+struct BookSlot {
+    Book book;
+    uint32_t generation = 0;
+    int32_t nextFree = -1;
+    uint8_t category = 0;    // Index into categoryLists
+    uint32_t position = 0;   // Index within that category's list
+    int32_t record = -1;     // Index in books.dat, -1 until written
+    string titleKey;         // Keys the sort orders last filed this book under
+    int32_t copiesKey = 0;
+};
+
+// Slab slots kept in key order, so a sorted page is read straight off the vector
+struct SortOrders {
+    vector<uint32_t> byTitle;   // Case-insensitive title, then ID
+    vector<uint32_t> byID;
+    vector<uint32_t> byCopies;  // Fewest copies first, then ID
+};
+
+const int32_t NOT_RETURNED = -1;
+
+// One loan in 24 bytes; dates are day numbers from daysFromDate(). The four 32-bit fields
+// were the original 16-byte record; the handle adds 8 so the title is found without
+// searching the catalog.
+struct BorrowedBookDetails {
+    int32_t id;
+    int32_t borrowDay;
+    int32_t returnDay = NOT_RETURNED;
+    int32_t overdueFee = 0;
+    BookHandle book;
+};
+static_assert(sizeof(BorrowedBookDetails) == 24, "loan records are meant to stay packed");
+
+// A loan added since the last compaction, chained to the borrower's previous overflow loan
+struct OverflowLoan {
+    BorrowedBookDetails loan;
+    int32_t next;
+};
+
+// The API's BorrowerInfo plus where this borrower's loans are kept
+struct Borrower : BorrowerInfo {
+    uint32_t loanBegin = 0, loanCount = 0;         // This borrower's range of the loan array
+    int32_t overflowHead = -1, overflowTail = -1;  // Loans added since the last compaction
+};
+
+// Running totals kept in step with borrowBook()/returnBook() so lookups never walk a loan history
+struct BorrowerStats {
+    int activeLoans = 0;          // Books currently held
+    long long lifetimeFees = 0;   // Every overdue fee ever charged
+};
+
+struct BookStats {
+    int timesBorrowed = 0;        // Lifetime borrow count
+    int currentlyOut = 0;         // Copies currently on loan
+};
+
+// Roaring-style ID set: IDs are grouped by their high 16 bits into chunks that are either a
+// sorted array of low halves (sparse) or a 65536-bit bitmap (dense)
+struct IdBitmap {
+    static const int ARRAY_LIMIT = 4096; // Past this an array chunk is larger than a bitmap
+    static const int BITMAP_WORDS = 1024;
+
+    struct Chunk {
+        uint16_t key;
+        int count = 0;
+        vector<uint16_t> array; // Sorted low halves while sparse
+        vector<uint64_t> bits;  // Non-empty once dense
+    };
+
+    vector<Chunk> chunks; // Sorted by key
+
+    const Chunk* findChunk(uint16_t key) const {
+        auto it = lower_bound(chunks.begin(), chunks.end(), key, [](const Chunk& c, uint16_t k) { return c.key < k; });
+        return (it != chunks.end() && it->key == key) ? &*it : nullptr;
+    }
+
+    static bool chunkHas(const Chunk& chunk, uint16_t low) {
+        if (!chunk.bits.empty()) return (chunk.bits[low >> 6] >> (low & 63)) & 1;
+        return binary_search(chunk.array.begin(), chunk.array.end(), low);
+    }
+
+    bool contains(int id) const {
+        if (id < 0) return false;
+        const Chunk* chunk = findChunk(uint16_t(uint32_t(id) >> 16));
+        return chunk && chunkHas(*chunk, uint16_t(id));
+    }
+
+    bool insert(int id) {
+        if (id < 0) return false;
+        uint16_t key = uint16_t(uint32_t(id) >> 16), low = uint16_t(id);
+        auto it = lower_bound(chunks.begin(), chunks.end(), key, [](const Chunk& c, uint16_t k) { return c.key < k; });
+        if (it == chunks.end() || it->key != key) {
+            it = chunks.insert(it, Chunk());
+            it->key = key;
+        }
+        Chunk& chunk = *it;
+
+        if (!chunk.bits.empty()) {
+            uint64_t mask = uint64_t(1) << (low & 63);
+            if (chunk.bits[low >> 6] & mask) return false;
+            chunk.bits[low >> 6] |= mask;
+        } else {
+            auto pos = lower_bound(chunk.array.begin(), chunk.array.end(), low);
+            if (pos != chunk.array.end() && *pos == low) return false;
+            chunk.array.insert(pos, low);
+            if (int(chunk.array.size()) > ARRAY_LIMIT) {
+                // Convert to a bitmap chunk
+                chunk.bits.assign(BITMAP_WORDS, 0);
+                for (uint16_t v : chunk.array) chunk.bits[v >> 6] |= uint64_t(1) << (v & 63);
+                vector<uint16_t>().swap(chunk.array);
+            }
+        }
+        chunk.count++;
+        return true;
+    }
+
+    bool erase(int id) {
+        if (id < 0) return false;
+        uint16_t key = uint16_t(uint32_t(id) >> 16), low = uint16_t(id);
+        auto it = lower_bound(chunks.begin(), chunks.end(), key, [](const Chunk& c, uint16_t k) { return c.key < k; });
+        if (it == chunks.end() || it->key != key) return false;
+        Chunk& chunk = *it;
+
+        if (!chunk.bits.empty()) {
+            uint64_t mask = uint64_t(1) << (low & 63);
+            if (!(chunk.bits[low >> 6] & mask)) return false;
+            chunk.bits[low >> 6] &= ~mask;
+            if (chunk.count - 1 <= ARRAY_LIMIT / 2) {
+                // Back to an array chunk once it is sparse again
+                for (int w = 0; w < BITMAP_WORDS; ++w) {
+                    for (uint64_t word = chunk.bits[w]; word; word &= word - 1) {
+                        chunk.array.push_back(uint16_t(w * 64 + __builtin_ctzll(word)));
+                    }
+                }
+                vector<uint64_t>().swap(chunk.bits);
+            }
+        } else {
+            auto pos = lower_bound(chunk.array.begin(), chunk.array.end(), low);
+            if (pos == chunk.array.end() || *pos != low) return false;
+            chunk.array.erase(pos);
+        }
+        if (--chunk.count == 0) chunks.erase(it);
+        return true;
+    }
+
+    // Smallest unused ID that is >= from
+    int nextFree(int from = 1) const {
+        uint32_t candidate = uint32_t(max(from, 0));
+        while (true) {
+            const Chunk* chunk = findChunk(uint16_t(candidate >> 16));
+            if (!chunk) return int(candidate);
+
+            uint32_t base = candidate & 0xFFFF0000u;
+            uint32_t low = candidate & 0xFFFFu;
+            if (!chunk->bits.empty()) {
+                for (uint32_t w = low >> 6; w < uint32_t(BITMAP_WORDS); ++w) {
+                    uint64_t freeBits = ~chunk->bits[w];
+                    if (w == (low >> 6)) freeBits &= ~uint64_t(0) << (low & 63);
+                    if (freeBits) return int(base + w * 64 + __builtin_ctzll(freeBits));
+                }
+            } else {
+                auto pos = lower_bound(chunk->array.begin(), chunk->array.end(), uint16_t(low));
+                for (; pos != chunk->array.end() && *pos == low; ++pos) {
+                    low++;
+                }
+                if (low <= 0xFFFFu) return int(base + low);
+            }
+            candidate = base + 0x10000u; // Chunk is full from here on
+        }
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const auto& chunk : chunks) total += chunk.count;
+        return total;
+    }
+
+    void clear() {
+        chunks.clear();
+    }
+};
+
+// One entry of the borrower name index; each borrower is filed under "last first" and "first last"
+struct NameKey {
+    string key;      // Lowercased name used for prefix matching
+    int borrowerID;
+
+    bool operator < (const NameKey& other) const {
+        return key < other.key || (key == other.key && borrowerID < other.borrowerID);
+    }
+};
+
+// Lowercased copy of a catalog title for fuzzy search
+struct TitleEntry {
+    string title;
+    int bookID;
+};
+
+struct TitleMatch {
+    int distance;    // Edits needed to find the query somewhere in the title
+    int lengthGap;   // Tie-breaker: titles close to the query length rank first
+    int bookID;
+
+    bool operator < (const TitleMatch& other) const {
+        if (distance != other.distance) return distance < other.distance;
+        if (lengthGap != other.lengthGap) return lengthGap < other.lengthGap;
+        return bookID < other.bookID;
+    }
+};
+
+// A parsed catalog query; every condition must hold
+struct BookQuery {
+    enum SortField { UNSORTED, BY_ID, BY_TITLE, BY_COPIES };
+
+    uint16_t categories = 0x3FF;    // Bit per category, indexed like categoryLists
+    int32_t idLow = INT32_MIN, idHigh = INT32_MAX;
+    int32_t copiesLow = INT32_MIN, copiesHigh = INT32_MAX;
+    vector<string> titleContains;   // Lowercased; all must appear in the title
+    SortField sortBy = UNSORTED;
+    bool descending = false;
+    size_t limit = SIZE_MAX;
+};
+
+// One row group of one column in a columnar export; utf8 columns add a data buffer after the offsets
+struct ColumnChunk {
+    uint64_t offset = 0, length = 0;
+    uint64_t dataOffset = 0, dataLength = 0;
+    uint32_t rows = 0;
+};
+
+struct ColumnSpec {
+    string name;
+    string type;                // int32, uint8 or utf8
+    string dictionary = {};     // Names the footer dictionary an encoded column indexes
+    vector<ColumnChunk> chunks = {};
+};
+
+struct ColumnTable {
+    string name;
+    uint64_t rows;
+    vector<ColumnSpec> columns;
+};
+
+// Streams column buffers to a file and closes it with a JSON footer describing where each one is
+struct ColumnarWriter {
+    ofstream out;
+    uint64_t position = 0;
+
+    bool open(const string& path);
+    uint64_t writeBlock(const void* data, size_t bytes);
+    template <typename T>
+    void writeColumn(ColumnSpec& column, const vector<T>& values) {
+        ColumnChunk chunk;
+        chunk.rows = uint32_t(values.size());
+        chunk.length = values.size() * sizeof(T);
+        chunk.offset = writeBlock(values.data(), chunk.length);
+        column.chunks.push_back(chunk);
+    }
+    void writeStrings(ColumnSpec& column, const vector<string>& values);
+    bool finish(const vector<ColumnTable>& tables);
+};
+
+// Tracks which chunks of a live vector changed since the last published snapshot
+struct SnapshotTracker {
+    set<size_t> dirtyChunks;
+    size_t dirtyFrom = SIZE_MAX; // Every chunk from here on changed (erase or reload)
+};
+
+// Immutable, versioned view of the catalog and borrowers. Live vectors are mirrored in
+// fixed-size chunks, so publishing a new version only copies the chunks that changed
+// and shares the rest with older versions still pinned by readers.
+struct BorrowerChunk {
+    vector<Borrower> borrowers;         // Loan ranges index the chunk's own loans below
+    vector<BorrowedBookDetails> loans;
+    vector<uint64_t> versions;          // Each borrower's render version when the chunk was built
+
+    size_t size() const { return borrowers.size(); }
+};
+
+struct LibrarySnapshot {
+    uint64_t version = 0;
+    array<vector<shared_ptr<const vector<Book>>>, 10> categoryChunks;
+    array<uint64_t, 10> categoryVersions = {}; // Render versions the chunks above correspond to
+    vector<shared_ptr<const BorrowerChunk>> borrowerChunks;
+};
+
+// Disk-resident borrower records. Each borrower is kept as its serialized line inside the
+// 4 KiB pages of a scratch file, found through an ID -> location index, and only the most
+// recently used borrowers are decoded in memory, within a byte budget.
+struct BorrowerStore {
+    static const size_t PAGE_SIZE = 4096;
+
+    struct Location {
+        uint64_t offset;   // Page * PAGE_SIZE + position within the page
+        uint32_t length;
+        uint32_t capacity; // Room reserved so a growing history can be rewritten in place
+    };
+
+    struct CacheEntry {
+        Borrower borrower;
+        list<int>::iterator lruPos;
+        size_t bytes;
+        bool dirty;
+    };
+
+    size_t budget = 0;           // 0 keeps every borrower in the borrowers vector instead
+    size_t cachedBytes = 0;
+    uint64_t fileEnd = 0;
+    fstream file;
+    unordered_map<int, Location> index;
+    unordered_map<int, CacheEntry> cache;
+    list<int> lru;               // Most recently used first
+    vector<int> order;           // IDs in load/insert order, so listings keep the file order
+
+    bool enabled() const { return budget > 0; }
+    bool open(const string& path, size_t budgetBytes);
+    Borrower* get(int id);
+    void insert(const Borrower& borrower, const BorrowedBookDetails* loanBase = nullptr);
+    void markDirty(int id);
+    void flush();
+    Borrower read(int id, vector<BorrowedBookDetails>& loans);
+    void write(int id, const Borrower& borrower, const BorrowedBookDetails* loanBase = nullptr);
+    void replace(const Borrower& borrower, const BorrowedBookDetails* loanBase = nullptr);
+    void erase(int id);
+    void uncache(int id);
+    void evictOverBudget();
+};
+
+// One fixed-width books.dat record; titles longer than the field are cut, books.txt keeps them whole
+struct BookRecord {
+    int32_t id;         // 0 marks a free record
+    int32_t copies;
+    uint8_t category;
+    uint8_t titleLength;
+    char title[54];
+};
+
+// Length and CRC32C of a data file's text, to tell whether it is still the version another file was written alongside
+struct TextStamp {
+    uint64_t length = 0;
+    uint32_t crc = 0;
+
+    bool operator == (const TextStamp& other) const { return length == other.length && crc == other.crc; }
+};
+
+// books.dat, memory-mapped so a borrow or return rewrites one copies field and flushes one page.
+// Its copy counts follow one books.txt, named by the stamp in the header; any other books.txt wins.
+struct BookRecordFile {
+    static constexpr size_t HEADER_SIZE = 64;   // Magic, the record count, then the books.txt stamp
+    static constexpr size_t STAMP_OFFSET = 16;
+    static constexpr char MAGIC[8] = {'B', 'O', 'O', 'K', 'D', 'A', 'T', '1'};
+
+    uint32_t count = 0;
+    size_t capacity = 0;         // Records the file has room for
+    size_t pendingBegin = SIZE_MAX, pendingEnd = 0; // Bytes written but not yet flushed
+#ifdef _WIN32
+    fstream file;
+    string data;                 // Whole-file copy written through by sync()
+#else
+    int fd = -1;
+    char* mapped = nullptr;
+    size_t mappedSize = 0;
+#endif
+
+    bool enabled() const { return capacity > 0; }
+    bool open(const string& path);
+    void rebuild();
+    void store(BookSlot& entry);
+    void storeCopies(const BookSlot& entry, bool flush = true);
+    void commit();
+    void remove(BookSlot& entry);
+    TextStamp textStamp() const;
+    void setTextStamp(const TextStamp& stamp);
+    BookRecord recordAt(uint32_t index) const;
+    void fill(const BookSlot& entry);
+    bool reserve(size_t records);
+    char* bytes() const;
+    char* header() const { return bytes(); }
+    size_t offsetOf(uint32_t index) const { return HEADER_SIZE + index * sizeof(BookRecord); }
+    void sync(size_t offset, size_t length);
+#ifndef _WIN32
+    bool map();
+#endif
+};
+
+// loans.log: each borrow and return committed since borrowers.txt was last saved, written in the
+// same commit as books.dat so a crash loses no loan whose copy books.dat already counted. The
+// first line stamps the borrowers.txt the loans follow; a save starts the journal over.
+struct LoanJournal {
+    string pending;              // Lines of the open transaction, written by commit()
+#ifdef _WIN32
+    string path;
+    ofstream file;
+#else
+    int fd = -1;
+#endif
+
+    bool enabled() const;
+    bool open(const string& path);
+    void restart(const TextStamp& borrowersStamp);
+    void noteBorrow(int borrowerID, const string& date, const vector<int>& bookIDs);
+    void noteReturn(int borrowerID, const string& date, const vector<int>& bookIDs, const vector<int>& fees);
+    void commit();
+};
+
+// One book or borrower in the shared catalog, found by hashing (kind, id) with linear probing.
+// The segment is mapped at a different address in every process, so records refer to their
+// text by offset from the start of the segment, never by pointer.
+struct SharedRecord {
+    int32_t id;              // 0 marks an unused slot; a removed record keeps its slot
+    uint8_t kind;            // SHARED_BOOK or SHARED_BORROWER
+    uint8_t removed;
+    uint16_t reserved;
+    int32_t copies;          // Books only: the shared copy count, which terminals adjust by delta
+    int32_t writer;          // Process that made the latest change
+    uint64_t offset;         // Where the record's line starts in the text arena
+    uint32_t length;
+    uint32_t reserved2;
+    uint64_t order;          // First-insert order, so every terminal lists records the same way
+    uint64_t sequence;       // Catalog sequence of the latest change
+};
+
+// A terminal attached to the shared catalog
+struct SharedTerminal {
+    int32_t pid;             // 0 marks a free entry
+    uint32_t unshared;       // Holds changes the segment had no room for, so no other terminal may save
+    uint64_t seen;           // Latest sequence it has applied; removals older than every terminal's may give up their slots
+};
+
+struct SharedCatalogHeader {
+    static constexpr uint32_t MAX_TERMINALS = 64;
+
+    char magic[8];
+    atomic<uint32_t> ready;      // SHARED_FILLING until the creator is done, then SHARED_READY or SHARED_ABANDONED
+    atomic<uint64_t> sequence;   // Bumped on every change; polled without taking the lock
+#ifndef _WIN32
+    pthread_mutex_t lock;        // Process-shared and robust, so a crashed terminal cannot wedge it
+#endif
+    int32_t creator;             // Process filling the segment; joiners stop waiting if it dies first
+    uint32_t tableSlots;         // A power of two, or 0 before the creator sizes the table
+    uint64_t usedSlots;          // Slots holding a record, live or removed
+    uint64_t segmentBytes;       // Size of the object; it only grows
+    uint64_t nextOrder;
+    uint64_t tableOffset;
+    uint64_t arenaOffset;        // The arena is last, so growing the object grows it
+    uint64_t arenaUsed;
+    SharedTerminal terminals[MAX_TERMINALS];
+};
+
+// The catalog shared by every terminal on the host: a POSIX shared-memory segment holding a
+// header, a hash table of records and an arena with each record's books.txt or borrowers.txt
+// line. Each terminal keeps its own indexes, writes its changes through here and picks up
+// everyone else's at menu boundaries. Every terminal maps SHARED_CATALOG_MAX_BYTES up front,
+// so when one grows the object the others see the new bytes at the same addresses.
+struct SharedCatalog {
+    char* base = nullptr;
+    size_t size = 0;                      // Bytes mapped; the object itself is header()->segmentBytes
+    int fd = -1;
+    string name;
+    int32_t pid = 0;
+    uint32_t terminal = 0;                // This process's entry in header()->terminals
+    bool created = false;                 // This process made the segment and fills it
+    bool applying = false;                // Applying other terminals' changes, so they are not echoed back
+    uint64_t seen = 0;                    // Latest sequence whose changes this process has applied
+    set<int> bookChanges, borrowerChanges; // Local changes not yet written to the segment
+    unordered_map<int, int> copiesBase;   // Shared copy count each local book was last in step with
+
+    bool enabled() const { return base != nullptr; }
+    bool open(const string& segmentName);
+    bool awaitCreator();
+    bool attach();
+    void abandon();
+    void leave();
+    void detach();
+    void unlinkIfCurrent();
+    void lock();
+    void unlock();
+    SharedCatalogHeader* header() const { return reinterpret_cast<SharedCatalogHeader*>(base); }
+    SharedRecord* table() const { return reinterpret_cast<SharedRecord*>(base + header()->tableOffset); }
+    SharedRecord* find(uint8_t kind, int id, bool create);
+    bool storeLine(SharedRecord& record, const string& line);
+    string lineOf(const SharedRecord& record) const { return string(base + record.offset, record.length); }
+    void compact();
+    bool rehash(size_t records);
+    bool growTo(uint64_t bytes);
+    void setSeen(uint64_t sequence);
+    uint64_t oldestSeen() const;
+    int32_t terminalWithUnshared() const;
+};
+
+// Slicing-by-8 tables for the software CRC32C, used where the CPU has no crc32 instruction
+struct Crc32cTable {
+    uint32_t entries[8][256];
+
+    Crc32cTable() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1)));
+            entries[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int slice = 1; slice < 8; ++slice) {
+                entries[slice][i] = (entries[slice - 1][i] >> 8) ^ entries[0][entries[slice - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+// One mutation as queued for the change stream. Plain data, so queuing it is a copy and the
+// writer thread does all the formatting.
+struct ChangeEvent {
+    uint64_t sequence;
+    int64_t timeMs;            // Wall clock, milliseconds since the epoch
+    uint8_t kind;              // CHANGE_* constant
+    uint8_t category;          // Book events: index into categoryLists
+    int32_t borrowerID;
+    int32_t bookID;
+    int32_t borrowDay, returnDay;
+    int32_t fee;
+    int32_t copies, owned;     // Book events: the book after the change
+    char text[84];             // Title or borrower name, cut at the field size
+};
+
+// Single-producer, single-consumer ring: only the main thread advances head and only the writer
+// thread advances tail, so each side needs one atomic load and one store per event
+struct ChangeRing {
+    static const size_t CAPACITY = 1 << 14;   // A power of two, so positions wrap with a mask
+
+    vector<ChangeEvent> slots;                // Sized by startChangeCapture(), so an unused stream costs nothing
+    alignas(64) atomic<uint64_t> head{0};     // Next position the producer fills
+    alignas(64) atomic<uint64_t> tail{0};     // Next position the consumer reads
+
+    bool push(const ChangeEvent& event);
+    size_t pop(vector<ChangeEvent>& batch, size_t limit);
+};
+
+// A loan as a span of days; loans still out end at OPEN_INTERVAL
+struct LoanInterval {
+    int32_t borrowDay;
+    int32_t endDay;
+    int32_t borrowerID;
+    int32_t bookID;
+
+    bool operator < (const LoanInterval& other) const {
+        if (borrowDay != other.borrowDay) return borrowDay < other.borrowDay;
+        if (borrowerID != other.borrowerID) return borrowerID < other.borrowerID;
+        if (bookID != other.bookID) return bookID < other.bookID;
+        return endDay < other.endDay;
+    }
+};
+
+struct IntervalBucket {
+    vector<LoanInterval> loans;
+    int32_t maxEnd = INT32_MIN;   // Latest end day of any loan in the bucket
+    int32_t openLoans = 0;        // Loans in the bucket that are still out
+};
+
+// Enough of a stat() result to tell one version of a file from the next
+struct FileStamp {
+    int64_t size = -1;      // -1 when the file could not be examined
+    int64_t modified = 0;   // Nanoseconds where the platform keeps them
+    int64_t inode = 0;      // Changes when an import renames a new file into place
+
+    bool operator == (const FileStamp& other) const {
+        return size == other.size && modified == other.modified && inode == other.inode;
+    }
+};
+
+// A data file watched for outside edits. The image is the file as this process last read or
+// wrote it; each new version is diffed against it and the changed records queued for the main thread.
+struct WatchedFile {
+    string path;
+    int (*recordID)(const string& line);
+    unordered_map<int, uint64_t> image = {}; // Record ID -> recordHash() of its line; filled by the loader, then owned by the watcher
+    bool changed = false;               // Watcher only: an event arrived and the file needs reading
+    FileStamp seen = {};                // Watcher only: last stamp seen while polling
+
+    // Shared with the main thread under reloadMutex
+    bool writing = false;               // Our own save is in progress
+    FileStamp written = {};             // Stamp our last save left, so the event it causes is skipped
+    map<int, string> upserts = {};      // Added or changed records waiting to be applied
+    set<int> removals = {};
+};
+
+struct ReloadCounts {
+    int added = 0, changed = 0, removed = 0;
+};
+
+// One open loan waiting in the due-date wheel
+struct DueEntry {
+    int borrowerID;
+    int bookID;
+    int borrowDay;
+    int dueDay;      // Fixed when the loan is scheduled; later refiling of the book does not move it
+};
+
+// A book some of the same patrons borrowed as another
+struct CoBorrow {
+    int bookID;
+    int borrowers;   // Patrons whose history holds both books
+
+    bool operator < (const CoBorrow& other) const {  // Ranks the strongest first
+        if (borrowers != other.borrowers) return borrowers > other.borrowers;
+        return bookID < other.bookID;
+    }
+};
+
+// One book's row of the co-borrowing matrix
+struct CoBorrowRow {
+    unordered_map<int, int> counts;  // Other book ID -> patrons who borrowed both
+    vector<CoBorrow> top;            // The strongest COBORROW_TOP_K, ranked
+};
+
+extern deque<BookSlot> bookSlab; // Books never move once placed
+extern int32_t freeBookSlot; // Deleted slots, chained through nextFree
+extern unordered_map<int, BookHandle> bookHandleByID; // Links loan records to their book as they load
+
+// A category's books in shelf order. The list holds handles into bookSlab, so erasing
+// shifts only handles and a Book& stays valid until that book itself is deleted
+struct BookList {
+    struct iterator {
+        using iterator_category = random_access_iterator_tag;
+        using value_type = Book;
+        using difference_type = ptrdiff_t;
+        using pointer = Book*;
+        using reference = Book&;
+
+        const BookHandle* at;
+
+        Book& operator * () const { return bookSlab[at->slot].book; }
+        Book* operator -> () const { return &**this; }
+        Book& operator [] (difference_type n) const { return bookSlab[at[n].slot].book; }
+        iterator& operator ++ () { ++at; return *this; }
+        iterator operator ++ (int) { iterator old = *this; ++at; return old; }
+        iterator& operator -- () { --at; return *this; }
+        iterator& operator += (difference_type n) { at += n; return *this; }
+        iterator operator + (difference_type n) const { return {at + n}; }
+        iterator operator - (difference_type n) const { return {at - n}; }
+        difference_type operator - (const iterator& other) const { return at - other.at; }
+        bool operator == (const iterator& other) const { return at == other.at; }
+        bool operator != (const iterator& other) const { return at != other.at; }
+        bool operator < (const iterator& other) const { return at < other.at; }
+    };
+
+    uint8_t category;
+    vector<BookHandle> handles;
+
+    explicit BookList(uint8_t category) : category(category) {}
+    iterator begin() const { return {handles.data()}; }
+    iterator end() const { return {handles.data() + handles.size()}; }
+    size_t size() const { return handles.size(); }
+    bool empty() const { return handles.empty(); }
+    BookHandle push_back(const Book& book);
+    void erase(iterator it);
+};
+
+extern BookList fictionBooks;
+extern BookList nonFictionBooks;
+extern BookList scienceBooks;
+extern BookList mysteryBooks;
+extern BookList romanceBooks;
+extern BookList biographyBooks;
+extern BookList historyBooks;
+extern BookList technologyBooks;
+extern BookList childrenBooks;
+extern BookList artBooks;
+extern vector<Borrower> borrowers;
+extern vector<BorrowedBookDetails> loanRecords; // Every loan, contiguous per borrower (CSR layout)
+extern vector<OverflowLoan> loanOverflow; // Loans added since the last save, folded back by compactLoans()
+extern int32_t overflowFreeList; // Released overflow slots, chained through next
+extern BorrowerStore borrowerStore;
+extern BookRecordFile bookRecords;
+extern LoanJournal loanJournal;
+extern TextStamp booksTextStamp;     // books.txt as last read or written
+extern TextStamp borrowersTextStamp; // borrowers.txt as last read or written
+extern SharedCatalog sharedCatalog;
+extern array<SortOrders, 10> categorySortOrders;
+extern SortOrders catalogSortOrders;
+extern BookList* const categoryLists[10];
+extern IdBitmap uniqueBookIDs;
+extern IdBitmap uniqueBorrowerIDs;
+extern unordered_map<int, BorrowerStats> borrowerStats;
+extern unordered_map<int, BookStats> bookStats;
+extern map<int, vector<DueEntry>> dueWheel; // Open loans bucketed by due day
+extern multimap<tuple<int, int, int>, int> scheduledDueDays; // (borrower, book, borrow day) -> bucket the loan is in
+extern map<int, IntervalBucket> loanIntervals; // Every loan, bucketed by borrow week
+extern set<int> openIntervalBuckets; // Weeks that still have a loan out
+extern int32_t longestClosedLoan; // Days the longest returned loan was out; only ever grows
+extern vector<NameKey> borrowerNameIndex; // Sorted by key for prefix lookups
+extern vector<TitleEntry> titleIndex; // Flat title list scanned by fuzzy search
+extern bool titleIndexDirty; // Set whenever a title is added, edited or removed
+extern unordered_map<int, CoBorrowRow> coBorrowIndex; // Sparse book x book counts over every loan history
+extern bool coBorrowDirty; // Set whenever a borrower's history is loaded, replaced or removed
+extern shared_ptr<const LibrarySnapshot> currentSnapshot;
+extern array<SnapshotTracker, 10> categoryTrackers;
+extern SnapshotTracker borrowerTracker;
+extern mutex snapshotWriteMutex; // Serializes writers publishing a new version
+extern uint64_t renderVersionClock; // Hands out the version numbers below
+extern array<uint64_t, 10> categoryVersions; // Bumped whenever a category's books change
+extern unordered_map<int, uint64_t> borrowerVersions; // Bumped whenever a borrower's record or loans change
+extern uint64_t titleVersion; // Bumped whenever a book title is added, edited or removed
+
+// Walks a borrower's loans: the contiguous range first, then the overflow chain
+struct LoanIterator {
+    const BorrowedBookDetails* base;
+    uint32_t index, end;
+    int32_t overflow;
+
+    const BorrowedBookDetails& operator * () const { return index < end ? base[index] : loanOverflow[overflow].loan; }
+    const BorrowedBookDetails* operator -> () const { return &**this; }
+    LoanIterator& operator ++ () {
+        if (index < end) index++;
+        else overflow = loanOverflow[overflow].next;
+        return *this;
+    }
+    bool operator != (const LoanIterator& other) const { return index != other.index || overflow != other.overflow; }
+};
+
+struct LoanRange {
+    LoanIterator first, last;
+
+    LoanIterator begin() const { return first; }
+    LoanIterator end() const { return last; }
+    bool empty() const { return !(first != last); }
+};
+
+const string BOOKS_FILE = "books.txt";
+const string BORROWERS_FILE = "borrowers.txt";
+const string BORROWER_STORE_FILE = "borrowers.db";
+const string BOOK_RECORDS_FILE = "books.dat";
+const string LOAN_JOURNAL_FILE = "loans.log";
+const string BORROWER_CACHE_ENV = "LIBRARY_BORROWER_CACHE_KB"; // Set to keep borrowers on disk with this cache size
+const string SHARED_CATALOG_ENV = "LIBRARY_SHARED_CATALOG"; // Set to a segment name to share the catalog between terminals
+const size_t SHARED_CATALOG_MAX_BYTES = size_t(1) << 30; // Address space each terminal reserves for the shared segment
+const size_t SHARED_HEADER_BYTES = 4096;   // The header's page; the table and arena follow it
+const uint32_t SHARED_TABLE_MIN_SLOTS = 4096; // The table keeps at least four slots per record, a power of two
+const int SHARED_CREATOR_WAIT_MS = 5000; // How long a segment may go without naming its creator before joiners remove it
+const uint32_t SHARED_FILLING = 0;
+const uint32_t SHARED_READY = 1;
+const uint32_t SHARED_ABANDONED = 2;
+const char SHARED_CATALOG_MAGIC[8] = {'L', 'I', 'B', 'S', 'H', 'M', '1', '\0'};
+const uint8_t SHARED_BOOK = 1;
+const uint8_t SHARED_BORROWER = 2;
+const string CHANGE_STREAM_ENV = "LIBRARY_CDC_PATH"; // Set to a file or named pipe to stream every change as JSON lines
+const string TRACE_ENV = "LIBRARY_TRACE_PATH"; // Set to a file to record a Chrome trace timeline, written when the library closes
+const string CHANGE_SEQUENCE_SUFFIX = ".seq"; // Sidecar holding the last sequence number written
+const size_t CHANGE_BATCH = 1024; // Most events the writer formats into one write
+const int CHANGE_FLUSH_MS = 50;   // Longest an event waits in the ring once the writer is idle
+const uint8_t CHANGE_BORROW = 1;
+const uint8_t CHANGE_RETURN = 2;
+const uint8_t CHANGE_BOOK_ADDED = 3;
+const uint8_t CHANGE_BOOK_CHANGED = 4;
+const uint8_t CHANGE_BOOK_REMOVED = 5;
+const uint8_t CHANGE_BORROWER_ADDED = 6;
+const uint8_t CHANGE_BORROWER_CHANGED = 7;
+const uint8_t CHANGE_BORROWER_REMOVED = 8;
+const size_t COBORROW_TOP_K = 5; // "Also borrowed" books kept ranked for each book
+const int LOAN_PERIOD_DAYS = 7; // Days a book may be kept before fees start
+const int DAILY_OVERDUE_FEE = 5; // Pesos per day past the due date
+const int NO_FEE_CAP = numeric_limits<int>::max();
+const size_t SNAPSHOT_CHUNK = 256; // Records per copy-on-write chunk
+const size_t QUERY_BOOKS_PER_THREAD = 65536; // Catalog queries smaller than this run on the calling thread
+const int INTERVAL_BUCKET_DAYS = 7; // Days of borrowing per interval-index bucket
+const int32_t OPEN_INTERVAL = INT32_MAX;
+const string CHECKSUM_SUFFIX = ".crc"; // Sidecar holding a data file's CRC32C checksums
+const size_t CHECKSUM_BLOCK = 65536;   // Bytes covered by each block checksum
+const string DAMAGED_SUFFIX = ".damaged"; // Copy of a data file as it was read when its checksums failed
+const size_t LOAD_ERROR_LIMIT = 10;    // Skipped records reported one by one before only counting
+const int WATCH_INTERVAL_MS = 500; // Longest the watcher sleeps between checks for changed data files
+const size_t EXPORT_ROW_GROUP = 65536; // Rows buffered per column before a columnar export writes them
+const char COLUMNAR_MAGIC[8] = {'L', 'I', 'B', 'C', 'O', 'L', '1', '\0'};
+
+// A fee rule fixed at compile time, so each category's calculator inlines to a few instructions
+template <int LoanDays, int DailyFee, int FeeCap>
+struct FeePolicy {
+    static constexpr int loanDays = LoanDays;
+
+    static int fee(int borrowDay, int returnDay) {
+        int overdueDays = max(0, returnDay - borrowDay - LoanDays);
+        return FeeCap == NO_FEE_CAP ? overdueDays * DailyFee : min(overdueDays * DailyFee, FeeCap);
+    }
+
+    // Same rule over a whole batch of loans, all assessed on one day
+    static void assess(const int* borrowDays, size_t count, int returnDay, int* fees) {
+        for (size_t i = 0; i < count; ++i) fees[i] = fee(borrowDays[i], returnDay);
+    }
+};
+
+using StandardLoan = FeePolicy<LOAN_PERIOD_DAYS, DAILY_OVERDUE_FEE, NO_FEE_CAP>;
+using ChildrenLoan = FeePolicy<14, 2, 100>;   // Longer loans, gentler fees
+using TechnologyLoan = FeePolicy<3, 10, 300>; // Short loans for high-demand titles
+
+struct CategoryFeeRule {
+    int loanDays;
+    int (*fee)(int borrowDay, int returnDay);
+    void (*assess)(const int* borrowDays, size_t count, int returnDay, int* fees);
+};
+
+template <typename Policy>
+constexpr CategoryFeeRule feeRule() {
+    return {Policy::loanDays, &Policy::fee, &Policy::assess};
+}
+
+// Indexed like categoryLists
+const CategoryFeeRule categoryFeeRules[10] = {
+    feeRule<StandardLoan>(), feeRule<StandardLoan>(), feeRule<StandardLoan>(), feeRule<StandardLoan>(),
+    feeRule<StandardLoan>(), feeRule<StandardLoan>(), feeRule<StandardLoan>(), feeRule<TechnologyLoan>(),
+    feeRule<ChildrenLoan>(), feeRule<StandardLoan>()
+};
+
+bool borrowBooks(int borrowerID, const vector<int>& bookIDs, const string& date, string& error);
+bool returnBooks(int borrowerID, const vector<int>& bookIDs, const string& date, vector<int>& fees, string& error);
+void commitTransaction();
+void bumpCategoryVersion(uint8_t category);
+void bumpBorrowerVersion(int borrowerID);
+void bumpTitleVersion();
+int calculateOverdueFee(BookHandle book, int borrowDay, int returnDay);
+const CategoryFeeRule& feeRuleFor(BookHandle book);
+vector<int> assessOverdueFees(const vector<DueEntry>& entries, int asOfDay);
+bool saveBooks();
+void loadBooks();
+bool saveBorrowers();
+void loadBorrowers();
+void addLoanStats(const Borrower& borrower, const BorrowedBookDetails* loanBase = nullptr);
+string serializeBorrower(const Borrower& borrower, const BorrowedBookDetails* loanBase = nullptr);
+Borrower parseBorrowerLine(const string& line, vector<BorrowedBookDetails>& loans);
+LoanRange loansOf(const Borrower& borrower, const BorrowedBookDetails* loanBase = nullptr);
+void appendLoan(Borrower& borrower, const BorrowedBookDetails& loan);
+BorrowedBookDetails* findOpenLoan(Borrower& borrower, int bookID);
+void releaseOverflowLoans(Borrower& borrower);
+void compactLoans();
+string returnDateText(const BorrowedBookDetails& loan);
+Borrower* findBorrower(int borrowerID);
+void recordBorrow(Borrower& borrower, Book& book, const string& borrowDate, bool commit = true);
+void recordReturn(Borrower& borrower, int bookID, int borrowDay, int returnDay, int overdueFee);
+void markBookChanged(const Book& book);
+bool loadBookRecords();
+TextStamp textStampOf(const string& text);
+void replayLoanJournal(bool adjustCopies);
+bool replayLoanLine(const string& line, bool adjustCopies);
+BookSlot* findBookSlot(const Book& book);
+void markBookRemoved(const BookList& books, size_t index);
+void linkSortOrders(uint32_t slot);
+void unlinkSortOrders(uint32_t slot);
+void reindexBook(uint32_t slot);
+void rebuildSortOrders();
+vector<Book> sortedPage(const vector<uint32_t>& order, size_t first, size_t count);
+void markBorrowerChanged(const Borrower& borrower);
+void publishSnapshot();
+void scheduleDue(int borrowerID, int bookID, int borrowDay);
+void cancelDue(int borrowerID, int bookID, int borrowDay);
+vector<DueEntry> loansDueOn(int day);
+void indexLoanInterval(int borrowerID, int bookID, int borrowDay, int endDay);
+void closeLoanInterval(int borrowerID, int bookID, int borrowDay, int returnDay);
+vector<LoanInterval> loansBorrowedBetween(int firstDay, int lastDay);
+vector<LoanInterval> loansOutDuring(int firstDay, int lastDay);
+string findBookTitle(const BorrowedBookDetails& loan);
+LoanInfo loanInfo(const BorrowedBookDetails& loan);
+vector<LoanInfo> loansTouched(int borrowerID, const vector<int>& bookIDs, const string& date, bool returned);
+LoanSpanResult loanSpans(const string& firstDate, const string& lastDate, vector<LoanInterval> (*search)(int firstDay, int lastDay));
+Book* resolveBook(BookHandle handle);
+BookHandle findBookHandle(int bookID);
+string lowercase(const string& text);
+string titleSortKey(const string& title);
+void appendNameKeys(const Borrower& borrower);
+void indexBorrowerName(const Borrower& borrower);
+vector<int> findBorrowersByName(const string& prefix, size_t limit);
+vector<TitleMatch> fuzzyTitleSearch(const string& query, size_t k);
+bool parseBookQuery(const string& text, BookQuery& query, string& error);
+vector<QueryRow> runBookQuery(const BookQuery& query);
+vector<int> historyBookIDs(const Borrower& borrower, const BorrowedBookDetails* loanBase = nullptr);
+void buildCoBorrowIndex();
+void noteCoBorrow(const Borrower& borrower, int bookID);
+vector<CoBorrow> alsoBorrowed(int bookID);
+int daysFromDate(const string& date);
+string dateFromDays(int days);
+int parseBookLine(const string& line, Book& book);
+int bookLineID(const string& line);
+int borrowerLineID(const string& line);
+uint64_t recordHash(const string& line);
+void beginSelfWrite(WatchedFile& file);
+void endSelfWrite(WatchedFile& file);
+void stopFileWatcher();
+void removeBook(BookHandle handle);
+void dropLoanStats(const Borrower& borrower, const BorrowedBookDetails* loanBase = nullptr);
+void loadBookLines(istream& in, const string& source);
+void loadBorrowerLines(istream& in, const string& source);
+bool parseBorrowerRecord(const string& line, vector<BorrowedBookDetails>& loans, Borrower& borrower);
+uint32_t crc32c(const char* data, size_t length);
+void writeChecksumFile(const string& path, const string& content);
+bool verifyChecksumFile(const string& path, const string& content);
+void reportLoadError(const string& source, size_t lineNumber, const string& problem, size_t& errors);
+void reportLoadErrorTotal(const string& source, size_t errors);
+string readWholeFile(ifstream& inFile);
+string bookLine(const Book& book, uint8_t category);
+string withCopies(const string& line, int copies);
+void noteSharedChange(uint8_t kind, int id);
+void populateSharedCatalog();
+void loadSharedCatalog();
+void shareChanges();
+string applySharedChanges();
+void unindexLoanInterval(int borrowerID, int bookID, int borrowDay, int endDay);
+void unindexBorrowerName(const Borrower& borrower);
+string jsonEscape(const string& text);
+void emitLoanChange(uint8_t kind, int borrowerID, int bookID, int borrowDay, int returnDay, int fee);
+void emitBookChange(uint8_t kind, const Book& book);
+void emitBorrowerChange(uint8_t kind, const Borrower& borrower);
+void stopChangeCapture();
+void startTracing(const string& path);
+void nameTraceThread(const string& name);
+bool writeTrace(const string& path, string& error);
+
+// Change stream state; the ring and counters are shared with the writer thread
+struct ChangeCapture {
+    bool enabled = false;
+    string path;
+    ChangeRing ring;
+    uint64_t nextSequence = 1;         // Main thread only
+    atomic<bool> stopping{false};
+    atomic<uint64_t> dropped{0};       // Ring was full
+    atomic<uint64_t> lost{0};          // Taken from the ring but still unwritten when the writer stopped
+    thread writer;
+#ifdef _WIN32
+    ofstream sink;
+#else
+    int fd = -1;
+#endif
+};
+extern ChangeCapture changeCapture;
+
+// One finished span, in microseconds since tracing started
+struct TraceEvent {
+    const char* name;
+    int64_t start;
+    int64_t duration;
+};
+
+// Spans recorded by one thread. Only that thread appends; the lock is for writeTrace().
+struct TraceBuffer {
+    mutex lock;
+    string threadName;
+    int tid = 0;
+    vector<TraceEvent> events;
+};
+
+// Timeline state; buffers are handed out to threads on their first span
+struct TraceLog {
+    atomic<bool> enabled{false};
+    string path;
+    chrono::steady_clock::time_point epoch;
+    mutex buffersMutex;
+    deque<TraceBuffer> buffers;        // A deque, so a thread's buffer never moves
+};
+extern TraceLog traceLog;
+
+// Times the enclosing scope into the calling thread's buffer; does nothing unless tracing is on
+struct TraceSpan {
+    const char* name;
+    int64_t start;
+    explicit TraceSpan(const char* spanName);
+    ~TraceSpan();
+};
+
+extern WatchedFile watchedBooks;
+extern WatchedFile watchedBorrowers;
+extern mutex reloadMutex; // Guards the shared half of each WatchedFile
+extern thread fileWatcher;
+extern atomic<bool> watcherStopping;
+
+// Visits every borrower, whether they live in the borrowers vector or in the disk store
+// fn receives the borrower and the loan array its range refers to
+template <typename Fn>
+void forEachBorrower(Fn fn) {
+    if (!borrowerStore.enabled()) {
+        for (const auto& borrower : borrowers) fn(borrower, loanRecords.data());
+        return;
+    }
+    vector<BorrowedBookDetails> scratch;
+    for (int id : borrowerStore.order) {
+        auto cached = borrowerStore.cache.find(id);
+        if (cached != borrowerStore.cache.end()) {
+            fn(cached->second.borrower, loanRecords.data());
+        } else {
+            scratch.clear();
+            Borrower borrower = borrowerStore.read(id, scratch); // Streamed past without filling the cache
+            fn(borrower, scratch.data());
+        }
+    }
+}
+
+#endif
@@ -1,13 +1,18 @@
+#include "library.h"
+
 #include <iostream>
-#include <vector>
-#include <string>
 #include <iomanip>
-#include <cmath>
-#include <limits>
+#include <sstream>
 #include <algorithm>
+#include <limits>
+#include <chrono>
 #include <set>
-#include <sstream>
-#include <fstream>
+#include <list>
+#include <unordered_map>
+#include <array>
+#include <cstdlib>
+
+using namespace std;
 
 // ANSI escape codes for colors
 #define RESET       "\033[0m"
@@ -22,49 +27,30 @@
 #define BOLD        "\033[1m"
 #define UNDERLINE   "\033[4m"
 
-using namespace std;
+const size_t RENDER_CACHE_BORROWERS = 512; // Borrowers whose rendered rows are kept
 
-struct Book {
-    int id;
-    string title;
-    int copies;
-
-    // Define an equality operator to compare books by their ID
-    bool operator == (const Book& other) const {
-        return id == other.id;
-    }
+// Formatted output kept for one view until the data it shows changes
+struct RenderedView {
+    uint64_t version = UINT64_MAX;   // Version of the data the text was rendered from
+    uint64_t titleVersion = 0;       // Borrower rows also show book titles
+    string text;
 };
 
-struct BorrowedBookDetails {
-    int id;
-    string dateBorrow;
-    string dateReturn;
-    int overdueFee = 0;
-};
+// Rendered borrower rows for the RENDER_CACHE_BORROWERS borrowers shown most recently, so a
+// pass over every borrower cannot pull the whole borrower file into memory as text
+struct BorrowerViewCache {
+    struct Entry {
+        RenderedView view;
+        list<int>::iterator lruPos;
+    };
+    unordered_map<int, Entry> entries;
+    list<int> lru;                   // Most recently shown first
 
-struct Borrower {
-    int id;
-    string lastName, firstName, middleInitial;
-    vector<BorrowedBookDetails> borrowedBooks; // Stores multiple borrowed books
+    RenderedView& get(int borrowerID);
 };
 
-
-vector<Book> fictionBooks;
-vector<Book> nonFictionBooks;
-vector<Book> scienceBooks;
-vector<Book> mysteryBooks;
-vector<Book> romanceBooks;
-vector<Book> biographyBooks;
-vector<Book> historyBooks;
-vector<Book> technologyBooks;
-vector<Book> childrenBooks;
-vector<Book> artBooks;
-vector<Borrower> borrowers;
-set<int> uniqueBookIDs;
-set<int> uniqueBorrowerIDs;
-
-const string BOOKS_FILE = "books.txt";
-const string BORROWERS_FILE = "borrowers.txt";
+array<RenderedView, 10> categoryViews; // Rendered rows of each category
+BorrowerViewCache borrowerViews; // Rendered rows of recently shown borrowers
 
 void displayMainMenu();
 void displayAddMenu();
@@ -77,192 +63,85 @@ void addBorrower();
 void viewBorrowers();
 void searchBorrower();
 void borrowBook();
-void displayBorrowedDetails(const Borrower& borrower);
+void displayBorrowedDetails(const BorrowerResult& borrower);
 void returnBook();
+void batchTransaction();
 void displayTableHeader();
 void displayTable(const vector<Book>& books, const string& header);
+void displayTableRows(const vector<Book>& books);
+void renderTableRows(ostream& out, const vector<Book>& books);
+const string& categoryRows(const LibrarySnapshot& snapshot, uint8_t category);
+void renderBorrowerRows(ostream& out, const BorrowerInfo& borrower, const vector<LoanInfo>& loans);
+const string& borrowerRows(const BorrowerInfo& borrower, uint64_t version, const function<vector<LoanInfo>()>& loans);
 void displayBorrowerTableHeader();
-void displayBorrowerTable(const Borrower& borrower);
-int calculateOverdueFee(const string& borrowDate, const string& returnDate);
-void saveBooks();
-void loadBooks();
-void saveBorrowers();
-void loadBorrowers();
+void displayBorrowerTable(const BorrowerResult& borrower);
 void displayLogo();
-
-bool isValidDate(const string& date) {
-    if (date.size() != 10 || date[4] != '-' || date[7] != '-') {
-        return false;
+void displaySortedBooks();
+void displayLeastAvailable();
+void loansByDateRange();
+void overdueReport();
+void searchBorrowerByName();
+void fuzzySearchBooks();
+void displayQueryResults(const vector<QueryRow>& rows);
+void queryBooks();
+void exportForAnalytics();
+string inventorySummary(const InventoryReport& report);
+void inventoryReconciliation();
+int runQueryCommand(const string& text);
+void printLibraryNotices();
+void displayAlsoBorrowed(int bookID);
+
+int main(int argc, char* argv[]) {
+    openLibrary();
+    printLibraryNotices();
+
+    // Batch mode: --query "<query>" prints the matching books and exits
+    if (argc >= 3 && string(argv[1]) == "--query") {
+        int status = runQueryCommand(argv[2]);
+        closeLibrary();
+        printLibraryNotices();
+        return status;
     }
-
-    int year, month, day;
-    if (sscanf(date.c_str(), "%d-%d-%d", &year, &month, &day) != 3) {
-        return false;
-    }
-
-    if (year < 1900 || year > 2100 || month < 1 || month > 12 || day < 1 || day > 31) {
-        return false;
-    }
-
-    if ((month == 4 || month == 6 || month == 9 || month == 11) && day > 30) {
-        return false;
-    }
-
-    if (month == 2) {
-        bool isLeap = (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
-        if (day > (isLeap ? 29 : 28)) {
-            return false;
+    // Batch mode: --export <file> writes the columnar analytics export and exits
+    if (argc >= 3 && string(argv[1]) == "--export") {
+        string error;
+        bool exported = exportColumnar(argv[2], error);
+        closeLibrary();
+        printLibraryNotices();
+        if (!exported) {
+            cerr << error << "\n";
+            return 1;
         }
+        return 0;
     }
-    return true;
-}
 
-int main() {
-    loadBooks();      // Load books at the start
-    loadBorrowers();
+    string inventory = inventorySummary(reconcileInventory());
+    if (!inventory.empty()) cout << YELLOW << BOLD << "\n" << inventory << RESET;
+
+    startChangeCapture();
+    startFileWatcher();
     displayMainMenu();
     borrowBook();
     return 0;
 }
 
-void saveBooks() {
-    ofstream outFile(BOOKS_FILE);
-    if (outFile.is_open()) {
-        for (const auto& book : fictionBooks) {
-            outFile << "Fiction," << book.id << "," << book.title << "," << book.copies << endl;
-        }
-        for (const auto& book : nonFictionBooks) {
-            outFile << "NonFiction," << book.id << "," << book.title << "," << book.copies << endl;
-        }
-        for (const auto& book : scienceBooks) {
-            outFile << "Science Fiction & Fantasy," << book.id << "," << book.title << "," << book.copies << endl;
-        }
-        for (const auto& book : mysteryBooks) {
-            outFile << "Mystery & Thriller," << book.id << "," << book.title << "," << book.copies << endl;
-        }
-        for (const auto& book : romanceBooks) {
-            outFile << "Romance," << book.id << "," << book.title << "," << book.copies << endl;
-        }
-        for (const auto& book : biographyBooks) {
-            outFile << "Biography & Autobiography," << book.id << "," << book.title << "," << book.copies << endl;
-        }
-        for (const auto& book : historyBooks) {
-            outFile << "History," << book.id << "," << book.title << "," << book.copies << endl;
-        }
-        for (const auto& book : technologyBooks) {
-            outFile << "Science & Technology," << book.id << "," << book.title << "," << book.copies << endl;
-        }
-        for (const auto& book : childrenBooks) {
-            outFile << "Children's Book," << book.id << "," << book.title << "," << book.copies << endl;
-        }
-        for (const auto& book : artBooks) {
-            outFile << "Art & Design," << book.id << "," << book.title << "," << book.copies << endl;
-        }
-
-        outFile.close();
-    } else {
-        cout << "Error opening books file for writing.\n";
-    }
-}
-
-void loadBooks() {
-    ifstream inFile(BOOKS_FILE);
-    if (inFile.is_open()) {
-        string line;
-        while (getline(inFile, line)) {
-            stringstream ss(line);
-            string category;
-            Book book;
-            getline(ss, category, ',');
-            ss >> book.id;
-            ss.ignore();  // Ignore the comma
-            getline(ss, book.title, ',');
-            ss >> book.copies;
-
-            // Add book to the appropriate category
-            if (category == "Fiction") fictionBooks.push_back(book);
-            else if (category == "NonFiction") nonFictionBooks.push_back(book);
-            else if (category == "Science Fiction & Fantasy") scienceBooks.push_back(book);
-            else if (category == "Mystery & Thriller") mysteryBooks.push_back(book);
-            else if (category == "Romance") romanceBooks.push_back(book);
-            else if (category == "Biography & Autobiography") biographyBooks.push_back(book);
-            else if (category == "History") historyBooks.push_back(book);
-            else if (category == "Science & Technology") scienceBooks.push_back(book);
-            else if (category == "Children's Book") childrenBooks.push_back(book);
-            else if (category == "Art & Design") artBooks.push_back(book);
-        }
-        inFile.close();
-    } else {
-        cout << "Error opening books file for reading.\n";
-    }
-}
-
-void saveBorrowers() {
-    ofstream outFile(BORROWERS_FILE);
-    if (outFile.is_open()) {
-        for (const auto& borrower : borrowers) {
-            outFile << borrower.id << "," << borrower.lastName << "," << borrower.firstName << ","
-                    << borrower.middleInitial << ",";
-
-            if (borrower.borrowedBooks.empty()) {
-                outFile << "~~~";
-            } else {
-                // Save borrowed book details
-                for (const auto& book : borrower.borrowedBooks) {
-                    outFile << book.id << "~" << book.dateBorrow << "~" << book.dateReturn << "~" << book.overdueFee << "~";
-                }
-                outFile.seekp(-1, ios_base::cur); // Remove the last '~'
-            }
-            outFile << "\n";
-        }
-        outFile.close();
-    } else {
-        cout << "Error opening borrowers file for writing.\n";
-    }
+// Shows what the library core has queued up since the last call
+void printLibraryNotices() {
+    for (const auto& notice : takeLibraryNotices()) cout << notice;
 }
 
-void loadBorrowers() {
-    ifstream inFile(BORROWERS_FILE);
-    if (inFile.is_open()) {
-        string line;
-        while (getline(inFile, line)) {
-            stringstream ss(line);
-            Borrower borrower;
-            string borrowedBookID, dateBorrow, dateReturn, strOverdueFee;
-
-            ss >> borrower.id;
-            ss.ignore();  // Ignore the comma
-            getline(ss, borrower.lastName, ',');
-            getline(ss, borrower.firstName, ',');
-            getline(ss, borrower.middleInitial, ',');
-
-            // Read borrowed book details
-            while (getline(ss, borrowedBookID, '~')) {
-                if (borrowedBookID.length() == 0) break; // No borrowed books
-                getline(ss, dateBorrow, '~');
-                getline(ss, dateReturn, '~');
-                getline(ss, strOverdueFee, '~');
-
-                BorrowedBookDetails borrowedBook;
-                borrowedBook.id = stoi(borrowedBookID);
-                borrowedBook.dateBorrow = dateBorrow;
-                borrowedBook.dateReturn = dateReturn;
-                try {
-                    borrowedBook.overdueFee = stoi(strOverdueFee);
-                } catch (const invalid_argument& e) {
-                    borrowedBook.overdueFee = 0; // Default to 0 if conversion fails
-                }
-
-                borrower.borrowedBooks.push_back(borrowedBook);
-            }
-
-            borrowers.push_back(borrower);
-            uniqueBorrowerIDs.insert(borrower.id); // Ensure unique IDs
-        }
-        inFile.close();
-    } else {
-        cout << "Error opening borrowers file for reading.\n";
+void displayQueryResults(const vector<QueryRow>& rows) {
+    cout << "\t--------------------------------------------------------------------------------\n";
+    cout << "\t| ID        | Title                      | Category                   | Copies  |\n";
+    cout << "\t--------------------------------------------------------------------------------\n";
+    for (const auto& row : rows) {
+        cout << "\t| " << setw(10) << right << row.book.id << "| "
+             << setw(25) << left << row.book.title.substr(0, 25) << "  | "
+             << setw(25) << left << CATEGORY_NAMES[row.category] << "  | "
+             << setw(7) << right << row.book.copies << " |\n";
     }
+    cout << "\t--------------------------------------------------------------------------------\n";
+    cout << "\t" << rows.size() << " book(s) matched.\n";
 }
 
 void displayLogo(){
@@ -279,14 +158,18 @@ void displayMainMenu() {
     int choice;
     do {
 
+        string reloaded = applyPendingReloads();
         displayLogo();
+        printLibraryNotices();
+        if (!reloaded.empty()) cout << YELLOW << BOLD << "\n" << reloaded << RESET;
         cout << BLUE << BOLD << "\n\t====MAIN MENU====\n" << RESET;
         cout << "\t[1] Add Menu\n";
         cout << "\t[2] Display Menu\n";
         cout << "\t[3] Search Menu\n";
         cout << "\t[4] Borrow Book\n";
         cout << "\t[5] Return Book\n";
-        cout << "\t[6] Exit\n";
+        cout << "\t[6] Borrow or Return Several Books\n";
+        cout << "\t[7] Exit\n";
         cout << BLUE << BOLD << "\tEnter your choice: " << RESET;
         cin >> choice;
 
@@ -307,13 +190,18 @@ void displayMainMenu() {
                 returnBook();
                 break;
             case 6:
+                batchTransaction();
+                break;
+            case 7:
                 char confirm;
                 cout << RED << BOLD <<"\tAre you sure you want to exit the system? (Y/N): " RESET;
                 cin >> confirm;
-                saveBooks();
-                saveBorrowers();
+                saveLibrary(); // Saves what every terminal has done, not just this one
+                printLibraryNotices();
                 if (confirm == 'Y' || confirm == 'y') {
                     cout << "\tExiting system. Goodbye!\n";
+                    closeLibrary();
+                    printLibraryNotices();
                     exit(0);
                 } else {
                     choice = 0; // Reset the choice to prevent exiting
@@ -330,7 +218,7 @@ void displayMainMenu() {
             break;
 
         }
-    } while (choice != 6);
+    } while (choice != 7);
 }
 
 void displayTableHeader() {
@@ -339,14 +227,37 @@ void displayTableHeader() {
     cout << "\t----------------------------------------------------\n";
 }
 
-void displayTable(const vector<Book>& books, const string& header = "") {
+void displayTable(const vector<Book>& books, const string& /*header*/ = "") {
+    displayTableRows(books);
+    cout << "\t----------------------------------------------------\n";
+}
+
+void displayTableRows(const vector<Book>& books) {
+    renderTableRows(cout, books);
+}
+
+void renderTableRows(ostream& out, const vector<Book>& books) {
     for (const auto& book : books) {
 
-        cout << "\t| " << setw(10) << right << book.id << "| "
-             << setw(25) << left << book.title.substr(0, 25) << "  | "
-             << setw(7) << right << book.copies << " |\n";
+        out << "\t| " << setw(10) << right << book.id << "| "
+            << setw(25) << left << book.title.substr(0, 25) << "  | "
+            << setw(7) << right << book.copies << " |\n";
     }
-    cout << "\t----------------------------------------------------\n";
+}
+
+// A category's rows as of the snapshot, rendered again only once its version has moved on
+const string& categoryRows(const LibrarySnapshot& snapshot, uint8_t category) {
+    RenderedView& view = categoryViews[category];
+    uint64_t version = categoryVersion(snapshot, category);
+    if (view.version != version) {
+        ostringstream out;
+        forEachBookChunk(snapshot, category, [&out](const vector<Book>& chunk) {
+            renderTableRows(out, chunk);
+        });
+        view.text = out.str();
+        view.version = version;
+    }
+    return view.text;
 }
 
 void displayAddMenu() {
@@ -383,7 +294,6 @@ void displayAddMenu() {
     } while (choice != 3);
 }
 
-
 void addBook() {
     int category;
 
@@ -416,13 +326,22 @@ void addBook() {
     system("CLS");
     Book newBook;
      displayLogo();
-    cout << "\tEnter Book ID: ";
-    cin >> newBook.id;
+    int suggestedID = nextBookID();
+    cout << "\tEnter Book ID (press Enter to use " << suggestedID << "): ";
+    string idInput;
+    getline(cin, idInput);
+    try {
+        newBook.id = idInput.empty() ? suggestedID : stoi(idInput);
+    } catch (const exception& e) {
+        newBook.id = -1;
+    }
 
-    cin.clear();
-    cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    if (newBook.id < 1) {
+        cout << RED << BOLD << "\tInvalid Book ID. Please enter a positive number.\n" << RESET;
+        return;
+    }
 
-    if (uniqueBookIDs.find(newBook.id) != uniqueBookIDs.end()) {
+    if (bookIDInUse(newBook.id)) {
         cout << RED << BOLD << "\tError: Book ID must be unique. Book not added.\n" << RESET;
         cout << BLUE << BOLD << "\n\tPress Enter to return to the Main menu..." << RESET;
         cin.clear();
@@ -440,30 +359,18 @@ void addBook() {
     getline(cin, copiesInput);
     if (!copiesInput.empty()) {
         newBook.copies = stoi(copiesInput);
+        newBook.owned = newBook.copies;
     } else {
         cout << RED << BOLD << "\tInvalid number of copies. Please enter a valid number.\n" << RESET;
         return;
     }
 
-    // Add the book to the respective category
-    switch (category) {
-        case 1: fictionBooks.push_back(newBook); break;
-        case 2: nonFictionBooks.push_back(newBook); break;
-        case 3: scienceBooks.push_back(newBook); break;
-        case 4: mysteryBooks.push_back(newBook); break;
-        case 5: romanceBooks.push_back(newBook); break;
-        case 6: biographyBooks.push_back(newBook); break;
-        case 7: historyBooks.push_back(newBook); break;
-        case 8: technologyBooks.push_back(newBook); break;
-        case 9: childrenBooks.push_back(newBook); break;
-        case 10: artBooks.push_back(newBook); break;
-        default:
-            cout << "Invalid category. Book not added.\n";
-            return;
+    BookResult added = addBookToCatalog(uint8_t(category - 1), newBook);
+    if (!added.ok) {
+        cout << RED << BOLD << "\t" << added.error << "\n" << RESET;
+        return;
     }
 
-    uniqueBookIDs.insert(newBook.id);
-
     // Display the recently added book
     cout << GREEN << BOLD <<"\n\tBOOK ADDED SUCCESSFULLY!\n" << RESET;
     cout << BLUE << BOLD << "\tRecently Added Book Details:\n" << RESET;
@@ -479,17 +386,18 @@ void addBook() {
     displayMainMenu();
 }
 
-void displayCategoryBooks(vector<Book>* books, const string& categoryName) {
-
+// Prints from a pinned snapshot, so borrows and returns can proceed while the table is on screen
+void displayCategoryBooks(const LibrarySnapshot& snapshot, uint8_t category, const string& categoryName) {
 
     cout << BLUE << BOLD << "\n\tCategory: " << categoryName << "\n" << RESET;
 
-    if (books->empty()) {
+    if (categoryEmpty(snapshot, category)) {
         cout << YELLOW << BOLD << "\tNo books available in this category.\n" << RESET;
     } else {
         // Call the displayTable function to display the table
         displayTableHeader();
-        displayTable(*books);
+        cout << categoryRows(snapshot, category);
+        cout << "\t----------------------------------------------------\n";
     }
 
     // Clear input buffer
@@ -510,7 +418,13 @@ void displayMenu() {
         cout << BLUE << BOLD << "\n\t==== Display Menu ====\n" << RESET;
         cout << "\t[1] Display Books\n";
         cout << "\t[2] View Borrowers\n";
-        cout << "\t[3] Back to Main Menu\n";
+        cout << "\t[3] Overdue Report\n";
+        cout << "\t[4] Sorted Books\n";
+        cout << "\t[5] Least Available Books\n";
+        cout << "\t[6] Loans by Date Range\n";
+        cout << "\t[7] Export Loans for Analytics\n";
+        cout << "\t[8] Inventory Reconciliation\n";
+        cout << "\t[9] Back to Main Menu\n";
         cout << BLUE << BOLD << "\tEnter your choice: " << RESET;
         cin >> displayChoice;
 
@@ -522,6 +436,24 @@ void displayMenu() {
                 viewBorrowers();
                 break;
             case 3:
+                overdueReport();
+                break;
+            case 4:
+                displaySortedBooks();
+                break;
+            case 5:
+                displayLeastAvailable();
+                break;
+            case 6:
+                loansByDateRange();
+                break;
+            case 7:
+                exportForAnalytics();
+                break;
+            case 8:
+                inventoryReconciliation();
+                break;
+            case 9:
                 system("CLS");
                 return;
 
@@ -536,7 +468,93 @@ void displayMenu() {
                 displayMainMenu();
 
         }
-    } while (displayChoice != 3);
+    } while (displayChoice != 9);
+}
+
+// Pages through a maintained order, so each screen costs only its own rows
+void displaySortedBooks() {
+    const size_t PAGE_ROWS = 20;
+    int category, key;
+    system("CLS");
+    displayLogo();
+    cout << BLUE << BOLD << "\n\tSelect Book Category:\n" << RESET;
+    for (int c = 0; c < 10; ++c) {
+        cout << "\t[" << c + 1 << "] " << CATEGORY_NAMES[c] << "\n";
+    }
+    cout << "\t[11] All books\n";
+    cout << BLUE << BOLD << "\tEnter category: " << RESET;
+    cin >> category;
+    cout << BLUE << BOLD << "\n\tSort by: [1] Title  [2] ID  [3] Copies: " << RESET;
+    cin >> key;
+
+    if (cin.fail() || category < 1 || category > 11 || key < 1 || key > 3) {
+        cin.clear();
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        cout << RED << BOLD << "\tInvalid choice.\n" << RESET;
+        return;
+    }
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+
+    uint8_t shown = category == 11 ? ALL_CATEGORIES : uint8_t(category - 1);
+    BookOrder order = key == 1 ? ORDER_BY_TITLE : key == 2 ? ORDER_BY_ID : ORDER_BY_COPIES;
+    BookPage page = sortedBooks(shown, order, 0, PAGE_ROWS);
+    if (page.total == 0) {
+        cout << YELLOW << BOLD << "\tNo books available in this category.\n" << RESET;
+        cout << BLUE << BOLD << "\n\tPress Enter to return to the Display Menu..." << RESET;
+        cin.get();
+        return;
+    }
+
+    for (size_t first = 0; first < page.total; first += PAGE_ROWS) {
+        if (first > 0) page = sortedBooks(shown, order, first, PAGE_ROWS);
+        system("CLS");
+        cout << BLUE << BOLD << "\n\tBooks " << first + 1 << "-" << min(page.total, first + PAGE_ROWS)
+             << " of " << page.total << "\n" << RESET;
+        displayTableHeader();
+        displayTable(page.books);
+        if (first + PAGE_ROWS >= page.total) break;
+
+        cout << BLUE << BOLD << "\n\tPress Enter for the next page, or Q then Enter to stop..." << RESET;
+        string answer;
+        getline(cin, answer);
+        if (answer == "q" || answer == "Q") return;
+    }
+    cout << BLUE << BOLD << "\n\tPress Enter to return to the Display Menu..." << RESET;
+    cin.get();
+}
+
+// The copies order already ranks the whole catalog, so the top k are just its first k entries
+void displayLeastAvailable() {
+    const size_t TOP_K = 10;
+    system("CLS");
+    displayLogo();
+    cout << BLUE << BOLD << "\n\t==== Least Available Books ====\n" << RESET;
+    BookPage page = sortedBooks(ALL_CATEGORIES, ORDER_BY_COPIES, 0, TOP_K);
+    if (page.books.empty()) {
+        cout << YELLOW << BOLD << "\tNo books available to display.\n" << RESET;
+    } else {
+        displayTableHeader();
+        displayTable(page.books);
+    }
+    cout << BLUE << BOLD << "\n\tPress Enter to return to the Display Menu..." << RESET;
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    cin.get();
+}
+
+void exportForAnalytics() {
+    string path, error;
+    cout << "\tEnter export file name (press Enter for " << COLUMNAR_EXPORT_FILE << "): ";
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    getline(cin, path);
+    if (path.empty()) path = COLUMNAR_EXPORT_FILE;
+
+    if (exportColumnar(path, error)) {
+        cout << GREEN << BOLD << "\tLoans and books exported to " << path << ".\n" << RESET;
+    } else {
+        cout << RED << BOLD << "\t" << error << "\n" << RESET;
+    }
+    cout << BLUE << BOLD << "\n\tPress Enter to return to the Display Menu..." << RESET;
+    cin.get();
 }
 
 void displayBooks() {
@@ -566,34 +584,38 @@ void displayBooks() {
         return;
     }
 
-    vector<pair<vector<Book>*, string>> categories = {
-        {&fictionBooks, "\tFiction"},
-        {&nonFictionBooks, "\tNon-Fiction"},
-        {&scienceBooks, "\tScience Fiction & Fantasy"},
-        {&mysteryBooks, "\tMystery & Thriller"},
-        {&romanceBooks, "\tRomance"},
-        {&biographyBooks, "\tBiography & Autobiography"},
-        {&historyBooks, "\tHistory"},
-        {&technologyBooks, "\tScience & Technology"},
-        {&childrenBooks, "\tChildren's Book"},
-        {&artBooks, "\tArt & Design"},
+    const string categoryNames[10] = {
+        "\tFiction",
+        "\tNon-Fiction",
+        "\tScience Fiction & Fantasy",
+        "\tMystery & Thriller",
+        "\tRomance",
+        "\tBiography & Autobiography",
+        "\tHistory",
+        "\tScience & Technology",
+        "\tChildren's Book",
+        "\tArt & Design",
     };
 
+    shared_ptr<const LibrarySnapshot> snapshot = pinSnapshot();
+
     if (category >= 1 && category <= 10) {
-        displayCategoryBooks(categories[category - 1].first, categories[category - 1].second);
+        displayCategoryBooks(*snapshot, uint8_t(category - 1), categoryNames[category - 1]);
     } else if (category == 11) {
-        vector<Book> allBooks;
-
-        for (const auto& cat : categories) {
-            allBooks.insert(allBooks.end(), cat.first->begin(), cat.first->end());
+        bool anyBooks = false;
+        for (uint8_t c = 0; c < 10; ++c) {
+            anyBooks = anyBooks || !categoryEmpty(*snapshot, c);
         }
 
         cout << BLUE << BOLD << "\n\tDisplaying all books:\n" << RESET;
-        if (allBooks.empty()) {
+        if (!anyBooks) {
             cout << YELLOW << BOLD <<"\tNo books available to display.\n" << RESET;
         } else {
             displayTableHeader();
-            displayTable(allBooks);
+            for (uint8_t c = 0; c < 10; ++c) {
+                cout << categoryRows(*snapshot, c);
+            }
+            cout << "\t----------------------------------------------------\n";
         }
 
         // Pause before returning
@@ -606,7 +628,6 @@ void displayBooks() {
     }
 }
 
-
 void searchBook() {
 
     system("CLS");  // Use "clear" for Unix/Linux systems
@@ -618,113 +639,116 @@ void searchBook() {
     cout << "\tEnter Book ID: ";
     cin >> bookID;
 
-    // Function to find and manage books
-    auto findAndManageBook = [&](vector<Book>& books) -> bool {
-        auto it = find_if(books.begin(), books.end(), [bookID](const Book& book) {
-            return book.id == bookID;
-        });
+    BookResult found = findBook(bookID);
+    if (found.ok) {
+        cout << GREEN << BOLD << "\n\tBook Found:\n" << RESET;
 
-        if (it != books.end()) {
-            cout << GREEN << BOLD << "\n\tBook Found:\n" << RESET;
+        displayTableHeader();
 
-            displayTableHeader();
+        // Display the found book details
+        vector<Book> foundBook = {found.book};  // Create a vector with the found book
+        displayTable(foundBook);  // Display the book in table format
+        cout << "\tTimes borrowed: " << found.timesBorrowed << "   Currently out: " << found.onLoan << "\n\n";
 
-            // Display the found book details
-            vector<Book> foundBook = {*it};  // Create a vector with the found book
-            displayTable(foundBook);  // Display the book in table format
-
-            cout << "\t[1] Edit\n";
-            cout << "\t[2] Delete\n";
-            cout << "\t[3] Go Back to Main Menu\n";
-            cout << BLUE << BOLD << "\tEnter your choice: " << RESET;
-            cin >> choice;
-
-            switch (choice) {
-                case 1: {
-                    // Ask which part of the book the user wants to edit
-                    int editChoice;
-                    cout << BLUE << BOLD << "\n\tWhat would you like to edit?\n" << RESET;
-                    cout << "\t[1] Title\n";
-                    cout << "\t[2] Number of Copies\n";
-                    cout << "\t[3] Both Title and Copies\n";
-                    cout << BLUE << BOLD << "\tEnter your choice: " << RESET;
-                    cin >> editChoice;
-
-                    if (editChoice == 1) {
-                        cout << BOLD <<"\tEnter new title: " << RESET;
-                        cin.ignore(); // Clear input buffer
-                        getline(cin, it->title);
-                        cout << GREEN << BOLD << "\tBook title updated successfully.\n" << RESET;
-                        system("CLS");
-                    }
-                    else if (editChoice == 2) {
-                        cout << BOLD << "\tEnter new number of copies: " << RESET;
-                        cin >> it->copies;
-                        cout << GREEN << BOLD << "\tNumber of copies updated successfully.\n" << RESET;
-                        system("CLS");
-                    }
-                    else if (editChoice == 3) {
-                        cout << BOLD << "\tEnter new title: " << RESET;
-                        cin.ignore(); // Clear input buffer
-                        getline(cin, it->title);
-                        cout << BOLD << "\tEnter new number of copies: " << RESET;
-                        cin >> it->copies;
-                        cout << GREEN << BOLD <<"\tBook updated successfully.\n" << RESET;
-                        system("CLS");
-                    }
-                    else {
-                        cout << RED << BOLD << "\tInvalid choice. Returning to Main Menu.\n" << RESET;
-                    }
+        cout << "\t[1] Edit\n";
+        cout << "\t[2] Delete\n";
+        cout << "\t[3] Go Back to Main Menu\n";
+        cout << BLUE << BOLD << "\tEnter your choice: " << RESET;
+        cin >> choice;
 
-                    displayLogo();
+        switch (choice) {
+            case 1: {
+                // Ask which part of the book the user wants to edit
+                int editChoice;
+                cout << BLUE << BOLD << "\n\tWhat would you like to edit?\n" << RESET;
+                cout << "\t[1] Title\n";
+                cout << "\t[2] Number of Copies\n";
+                cout << "\t[3] Both Title and Copies\n";
+                cout << BLUE << BOLD << "\tEnter your choice: " << RESET;
+                cin >> editChoice;
+
+                Book edited = found.book;
+                if (editChoice == 1) {
+                    cout << BOLD <<"\tEnter new title: " << RESET;
+                    cin.ignore(); // Clear input buffer
+                    getline(cin, edited.title);
+                    cout << GREEN << BOLD << "\tBook title updated successfully.\n" << RESET;
+                    system("CLS");
+                }
+                else if (editChoice == 2) {
+                    cout << BOLD << "\tEnter new number of copies: " << RESET;
+                    cin >> edited.copies;
+                    cout << GREEN << BOLD << "\tNumber of copies updated successfully.\n" << RESET;
+                    system("CLS");
+                }
+                else if (editChoice == 3) {
+                    cout << BOLD << "\tEnter new title: " << RESET;
+                    cin.ignore(); // Clear input buffer
+                    getline(cin, edited.title);
+                    cout << BOLD << "\tEnter new number of copies: " << RESET;
+                    cin >> edited.copies;
+                    cout << GREEN << BOLD <<"\tBook updated successfully.\n" << RESET;
+                    system("CLS");
+                }
+                else {
+                    cout << RED << BOLD << "\tInvalid choice. Returning to Main Menu.\n" << RESET;
+                }
+
+                BookResult updated = updateBook(edited);
+                displayLogo();
 
-                    // Display the updated book details in a tabular format
-                    cout << BLUE << BOLD << "\n\tUpdated Book:\n" << RESET;
+                // Display the updated book details in a tabular format
+                cout << BLUE << BOLD << "\n\tUpdated Book:\n" << RESET;
 
-                    displayTableHeader();  // Display the table header
+                displayTableHeader();  // Display the table header
 
-                    vector<Book> updatedBook = {*it};  // Create a vector with the updated book
+                vector<Book> updatedBook = {updated.book};  // Create a vector with the updated book
 
-                    displayTable(updatedBook);  // Display the updated book in table format
-                    // Pause before returning to the search menu
+                displayTable(updatedBook);  // Display the updated book in table format
+                // Pause before returning to the search menu
+                cout << BLUE << BOLD << "\n\tPress Enter to return to the Search Menu..." << RESET;
+                cin.ignore();
+                cin.get();
+                break;
+            }
+            case 2:
+                char confirm;
+                if (found.onLoan > 0) {
+                    cout << RED << BOLD << "\tThis book cannot be deleted while " << found.onLoan << " copies are on loan.\n" << RESET;
                     cout << BLUE << BOLD << "\n\tPress Enter to return to the Search Menu..." << RESET;
                     cin.ignore();
                     cin.get();
                     break;
                 }
-                case 2:
-                    char confirm;
-                    cout << RED << BOLD << "\tAre you sure you want to delete this book? (y/n): " << RESET;
-                    cin >> confirm;
-                    if (confirm == 'y' || confirm == 'Y') {
-                        books.erase(it); // Remove the book from the list
+                cout << RED << BOLD << "\tAre you sure you want to delete this book? (y/n): " << RESET;
+                cin >> confirm;
+                if (confirm == 'y' || confirm == 'Y') {
+                    LibraryStatus removed = removeBookFromCatalog(bookID);
+                    if (removed.ok) {
                         cout << GREEN << BOLD << "\tBook deleted successfully.\n" << RESET;
                     } else {
-                        cout << GREEN << BOLD << "\tBook deletion canceled.\n" << RESET;
+                        cout << RED << BOLD << "\t" << removed.error << "\n" << RESET;
                     }
-                     // Pause before returning to the search menu
-                    cout << BLUE << BOLD << "\n\tPress Enter to return to the Search Menu..." << RESET;
-                    cin.ignore();
-                    cin.get();
-                    break;
-                case 3:
-                    cout << "\tReturning to Search Menu.\n";
-                    return true;
-                default:
-                    cout << RED << BOLD << "Invalid choice. Please try again.\n" << RESET;
-                    cout << BLUE << BOLD <<"\nPress Enter to return to the main menu..." << RESET;
-                    cin.clear();
-                    cin.ignore();
-                    cin.get();
-                    system("CLS"); // Use "clear" for Unix/Linux systems
-            }
-            return true;
+                } else {
+                    cout << GREEN << BOLD << "\tBook deletion canceled.\n" << RESET;
+                }
+                 // Pause before returning to the search menu
+                cout << BLUE << BOLD << "\n\tPress Enter to return to the Search Menu..." << RESET;
+                cin.ignore();
+                cin.get();
+                break;
+            case 3:
+                cout << "\tReturning to Search Menu.\n";
+                return;
+            default:
+                cout << RED << BOLD << "Invalid choice. Please try again.\n" << RESET;
+                cout << BLUE << BOLD <<"\nPress Enter to return to the main menu..." << RESET;
+                cin.clear();
+                cin.ignore();
+                cin.get();
+                system("CLS"); // Use "clear" for Unix/Linux systems
         }
-        return false;
-    };
-
-    // Search in fictionBooks and nonFictionBooks
-    if (!findAndManageBook(fictionBooks) && !findAndManageBook(nonFictionBooks) && !findAndManageBook(scienceBooks)  && !findAndManageBook(mysteryBooks ) && !findAndManageBook(romanceBooks) && !findAndManageBook(biographyBooks) && !findAndManageBook(historyBooks) && !findAndManageBook(technologyBooks) && !findAndManageBook(childrenBooks) && !findAndManageBook(artBooks)) {
+    } else {
         cout << RED << BOLD << "\tBook not found.\n" << RESET;
 
         // Pause before returning to the search menu
@@ -742,7 +766,10 @@ void displaySearchMenu() {
         cout << BLUE << BOLD << "\t==== Search Menu ====\n" << RESET;
         cout << "\t[1] Search Book\n";
         cout << "\t[2] Search Borrower\n";
-        cout << "\t[3] Return to Main Menu\n";
+        cout << "\t[3] Search Borrower by Name\n";
+        cout << "\t[4] Fuzzy Title Search\n";
+        cout << "\t[5] Query Books\n";
+        cout << "\t[6] Return to Main Menu\n";
         cout << BLUE << BOLD << "\tEnter your choice: " << RESET;
         cin >> choice;
 
@@ -754,6 +781,15 @@ void displaySearchMenu() {
                 searchBorrower();
                 break;
             case 3:
+                searchBorrowerByName();
+                break;
+            case 4:
+                fuzzySearchBooks();
+                break;
+            case 5:
+                queryBooks();
+                break;
+            case 6:
                 cout << "\tReturning to Main Menu.\n";
                 system("CLS");
                 return;
@@ -766,7 +802,102 @@ void displaySearchMenu() {
                 system("CLS"); // Use "clear" for Unix/Linux systems
                 displayMainMenu();
         }
-    } while (choice != 3);
+    } while (choice != 6);
+}
+
+void fuzzySearchBooks() {
+    const size_t MAX_RESULTS = 10;
+    string query;
+    system("CLS");
+    displayLogo();
+    cout << BLUE << BOLD << "\tEnter title (spelling need not be exact): " << RESET;
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    getline(cin, query);
+
+    SearchResult matches = searchTitles(query, MAX_RESULTS);
+    if (matches.rows.empty()) {
+        cout << RED << BOLD << "\tNo titles resemble \"" << query << "\".\n" << RESET;
+    } else {
+        cout << GREEN << BOLD << "\n\tClosest Titles:\n" << RESET;
+        cout << "\t----------------------------------------------------\n";
+        cout << "\t| ID        | Title                      | Edits   |\n";
+        cout << "\t----------------------------------------------------\n";
+        for (size_t i = 0; i < matches.rows.size(); ++i) {
+            const Book& book = matches.rows[i].book;
+            cout << "\t| " << setw(10) << right << book.id << "| "
+                 << setw(25) << left << book.title.substr(0, 25) << "  | "
+                 << setw(7) << right << matches.distances[i] << " |\n";
+        }
+        cout << "\t----------------------------------------------------\n";
+    }
+
+    cout << BLUE << BOLD << "\n\tPress Enter to return to the Search Menu..." << RESET;
+    cin.get();
+}
+
+void queryBooks() {
+    string text;
+    system("CLS");
+    displayLogo();
+    cout << BLUE << BOLD << "\tQuery Books\n" << RESET;
+    cout << "\tExample: category in History, \"Art & Design\" and copies = 0 and title contains war sort title limit 20\n";
+    cout << BLUE << BOLD << "\tEnter query: " << RESET;
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    getline(cin, text);
+
+    SearchResult result = searchCatalog(text);
+    if (!result.ok) {
+        cout << RED << BOLD << "\t" << result.error << "\n" << RESET;
+    } else {
+        displayQueryResults(result.rows);
+    }
+
+    cout << BLUE << BOLD << "\n\tPress Enter to return to the Search Menu..." << RESET;
+    cin.get();
+}
+
+// Batch mode: prints the result table and exits with 1 if the query does not parse
+int runQueryCommand(const string& text) {
+    SearchResult result = searchCatalog(text);
+    if (!result.ok) {
+        cerr << result.error << "\n";
+        return 1;
+    }
+    displayQueryResults(result.rows);
+    return 0;
+}
+
+void searchBorrowerByName() {
+    const size_t MAX_RESULTS = 20;
+    string prefix;
+    system("CLS");
+    displayLogo();
+    cout << BLUE << BOLD << "\tEnter the start of a surname or first name: " << RESET;
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    getline(cin, prefix);
+
+    vector<BorrowerSummary> matches = searchBorrowerNames(prefix, MAX_RESULTS);
+    if (matches.empty()) {
+        cout << RED << BOLD << "\tNo borrower names start with \"" << prefix << "\".\n" << RESET;
+    } else {
+        cout << GREEN << BOLD << "\n\tMatching Borrowers:\n" << RESET;
+        cout << "\t-----------------------------------------------------------\n";
+        cout << "\t| ID        | Full Name                | Books Borrowed   |\n";
+        cout << "\t-----------------------------------------------------------\n";
+        for (const auto& match : matches) {
+            const BorrowerInfo& it = match.borrower;
+            cout << "\t| " << left << setw(10) << it.id
+                 << "| " << setw(25) << (it.firstName + " " + it.middleInitial + " " + it.lastName).substr(0, 24)
+                 << "| " << setw(17) << match.activeLoans << "|\n";
+        }
+        cout << "\t-----------------------------------------------------------\n";
+        if (matches.size() == MAX_RESULTS) {
+            cout << YELLOW << BOLD << "\tShowing the first " << MAX_RESULTS << " matches. Type more letters to narrow the search.\n" << RESET;
+        }
+    }
+
+    cout << BLUE << BOLD << "\n\tPress Enter to return to the Search Menu..." << RESET;
+    cin.get();
 }
 
 void searchBorrower() {
@@ -777,11 +908,10 @@ void searchBorrower() {
     cin >> borrowerID;
 
     // Find borrower by ID
-    auto it = find_if(borrowers.begin(), borrowers.end(), [borrowerID](const Borrower& b) {
-        return b.id == borrowerID;
-    });
+    BorrowerResult found = findBorrowerRecord(borrowerID);
 
-    if (it != borrowers.end()) {
+    if (found.ok) {
+        const BorrowerInfo* it = &found.borrower;
         cout << GREEN << BOLD << "\n\tBorrower Found:\n" << RESET;
         cout << "\t--------------------------------------\n";
         cout << "\t| " << setw(10) << "ID" << " | " << setw(20) << "Name" << "  |\n";
@@ -789,8 +919,8 @@ void searchBorrower() {
         cout << "\t| " << setw(10) << it->id << " | "
              << setw(20) << it->firstName + it->middleInitial + " " + it->lastName << "  |\n";
         cout << "\t--------------------------------------\n";
-
-
+        cout << "\tBooks currently borrowed: " << found.activeLoans << "/" << MAX_ACTIVE_LOANS
+             << "   Total fees charged: " << found.lifetimeFees << " pesos\n";
 
         // Provide options
         int choice;
@@ -800,7 +930,7 @@ void searchBorrower() {
         cin >> choice;
 
         if (choice == 1) {
-            if (it->borrowedBooks.empty()) {
+            if (found.loans.empty()) {
                 cout << RED << BOLD << "\tNo borrowed books.\n" << RESET;
             } else {
                 system("CLS");
@@ -812,22 +942,10 @@ void searchBorrower() {
                         << " \t| " << setw(20) << "Date Returned" << " |\n";
                 cout << "\t----------------------------------------------------------------------\n";
 
-                for (const auto& book : it->borrowedBooks) {
-                    string bookTitle;
-                    for (const auto& category : {fictionBooks, nonFictionBooks, scienceBooks, mysteryBooks, romanceBooks,
-                                                 biographyBooks, historyBooks, technologyBooks, childrenBooks, artBooks}) {
-                        auto it = find_if(category.begin(), category.end(), [&book](const Book& b) {
-                            return b.id == book.id;
-                        });
-                        if (it != category.end()) {
-                            bookTitle = it->title;
-                            break;
-                        }
-                    }
-
-                    cout << "\t| " << setw(20) << bookTitle
-                         << " \t| " << setw(20) << book.dateBorrow
-                         << " \t| " << setw(20) << (book.dateReturn.empty() ? "Not Returned" : book.dateReturn) << " |\n";
+                for (const auto& book : found.loans) {
+                    cout << "\t| " << setw(20) << book.title
+                         << " \t| " << setw(20) << book.borrowDate
+                         << " \t| " << setw(20) << (book.returnDate.empty() ? "Not Returned" : book.returnDate) << " |\n";
                     cout << "\t----------------------------------------------------------------------\n";
                 }
             }
@@ -849,23 +967,33 @@ void searchBorrower() {
     }
 }
 
-
 void addBorrower() {
-    Borrower newBorrower;
+    BorrowerInfo newBorrower;
     system("CLS");
     displayLogo();
-    cout << "\tEnter Borrower ID: ";
-    cin >> newBorrower.id;
+    cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear the input buffer
+
+    int suggestedID = nextBorrowerID();
+    cout << "\tEnter Borrower ID (press Enter to use " << suggestedID << "): ";
+    string idInput;
+    getline(cin, idInput);
+    try {
+        newBorrower.id = idInput.empty() ? suggestedID : stoi(idInput);
+    } catch (const exception& e) {
+        newBorrower.id = -1;
+    }
+
+    if (newBorrower.id < 1) {
+        cout << RED << BOLD << "\tInvalid Borrower ID. Please enter a positive number.\n" << RESET;
+        return;
+    }
 
     // Check if the ID is unique
-    if (uniqueBorrowerIDs.find(newBorrower.id) != uniqueBorrowerIDs.end()) {
+    if (borrowerIDInUse(newBorrower.id)) {
         cout << RED << BOLD << "\tError: Borrower ID must be unique. Borrower not added.\n" << RESET;
         return;
     }
 
-
-    cin.ignore();
-     // Clear the input buffer
     cout << "\tEnter Last Name: ";
     getline(cin, newBorrower.lastName);
     cout << "\tEnter First Name: ";
@@ -873,20 +1001,22 @@ void addBorrower() {
     cout << "\tEnter Middle Initial: ";
     getline(cin, newBorrower.middleInitial);
 
-    borrowers.push_back(newBorrower);
-    uniqueBorrowerIDs.insert(newBorrower.id); // Add the ID to the unique set
+    BorrowerResult added = addBorrowerRecord(newBorrower);
+    if (!added.ok) {
+        cout << RED << BOLD << "\t" << added.error << "\n" << RESET;
+        return;
+    }
     cout << GREEN << BOLD << "\tBorrower added successfully!\n" << RESET;
 
     // Display the recently added borrower in table format
     displayBorrowerTableHeader();
-    displayBorrowerTable(newBorrower);
+    displayBorrowerTable(added);
     cout << "\n\tPress Enter to return to the Display Menu...";
 
     cin.clear(); // Clear any error flags
 
     cin.get(); // Waits for the user to press Enter
 
-
 }
 
 void displayBorrowerTableHeader() {
@@ -896,53 +1026,79 @@ void displayBorrowerTableHeader() {
 
 }
 
-void displayBorrowerTable(const Borrower& borrower) {
-    if (borrower.borrowedBooks.empty()) {
+void displayBorrowerTable(const BorrowerResult& borrower) {
+    cout << borrowerRows(borrower.borrower, borrowerVersion(borrower.borrower.id), [&borrower]() { return borrower.loans; });
+}
 
-        cout << "\t| " << left << setw(10) << borrower.id
-             << "| " << setw(25) << borrower.firstName + " " + borrower.middleInitial + " " + borrower.lastName
-             << "| " << setw(20) << "No books borrowed"  // Indicating no books borrowed
-             << "| " << setw(14) << "N/A"               // No borrow date
-             << "| " << setw(12) << "N/A"               // No return date
-             << "| " << setw(6) << "N/A" << "|\n";
-    } else {
-        for (const auto& bookDetails : borrower.borrowedBooks) {
-            string bookTitle;
-            for (const auto& category : {fictionBooks, nonFictionBooks, scienceBooks, mysteryBooks, romanceBooks,
-                                            biographyBooks, historyBooks, technologyBooks, childrenBooks, artBooks}) {
-                auto it = find_if(category.begin(), category.end(), [&bookDetails](const Book& b) {
-                    return b.id == bookDetails.id;
-                });
-                if (it != category.end()) {
-                    bookTitle = it->title;
-                    break;
-                }
-            }
+void renderBorrowerRows(ostream& out, const BorrowerInfo& borrower, const vector<LoanInfo>& loans) {
+    if (loans.empty()) {
 
-            cout << "\t| " << left << setw(10) << borrower.id
-                 << "| " << setw(25) << borrower.firstName + " " + borrower.middleInitial + " " + borrower.lastName
-                 << "| " << setw(20) << bookTitle
-                 << "| " << setw(14) << bookDetails.dateBorrow
-                 << "| " << setw(12) << bookDetails.dateReturn
-                 << "| " << setw(6) << bookDetails.overdueFee << "|\n";
+        out << "\t| " << left << setw(10) << borrower.id
+            << "| " << setw(25) << borrower.firstName + " " + borrower.middleInitial + " " + borrower.lastName
+            << "| " << setw(20) << "No books borrowed"  // Indicating no books borrowed
+            << "| " << setw(14) << "N/A"               // No borrow date
+            << "| " << setw(12) << "N/A"               // No return date
+            << "| " << setw(6) << "N/A" << "|\n";
+    } else {
+        for (const auto& bookDetails : loans) {
+            out << "\t| " << left << setw(10) << borrower.id
+                << "| " << setw(25) << borrower.firstName + " " + borrower.middleInitial + " " + borrower.lastName
+                << "| " << setw(20) << bookDetails.title
+                << "| " << setw(14) << bookDetails.borrowDate
+                << "| " << setw(12) << bookDetails.returnDate
+                << "| " << setw(6) << bookDetails.overdueFee << "|\n";
         }
     }
-    cout << "\t----------------------------------------------------------------------------------------------------\n";
+    out << "\t----------------------------------------------------------------------------------------------------\n";
+}
+
+// The returned view stays valid until the next call
+RenderedView& BorrowerViewCache::get(int borrowerID) {
+    auto cached = entries.find(borrowerID);
+    if (cached != entries.end()) {
+        lru.splice(lru.begin(), lru, cached->second.lruPos);
+        return cached->second.view;
+    }
+    if (entries.size() >= RENDER_CACHE_BORROWERS) {
+        entries.erase(lru.back());
+        lru.pop_back();
+    }
+    lru.push_front(borrowerID);
+    Entry& entry = entries[borrowerID];
+    entry.lruPos = lru.begin();
+    return entry.view;
+}
+
+// A borrower's rows at the given version, rendered again only once it or a title has changed;
+// the loans are only fetched when the rows have to be rendered
+const string& borrowerRows(const BorrowerInfo& borrower, uint64_t version, const function<vector<LoanInfo>()>& loans) {
+    RenderedView& view = borrowerViews.get(borrower.id);
+    uint64_t titles = titlesVersion();
+    if (view.version != version || view.titleVersion != titles) {
+        ostringstream out;
+        renderBorrowerRows(out, borrower, loans());
+        view.text = out.str();
+        view.version = version;
+        view.titleVersion = titles;
+    }
+    return view.text;
 }
 
 void viewBorrowers() {
     cout << BLUE << BOLD << "\n\t==== List of Borrowers ====\n" << RESET;
 
-    if (borrowers.empty()) {
+    // Walk a pinned version rather than the live vector
+    shared_ptr<const LibrarySnapshot> snapshot = pinSnapshot();
+    if (borrowersEmpty(*snapshot)) {
         cout << RED << BOLD << "\tNo borrowers found.\n" << RESET;
     } else {
         // Display table header
         displayBorrowerTableHeader();
 
         // Display details for each borrower
-        for (const auto& borrower : borrowers) {
-            displayBorrowerTable(borrower);
-        }
+        forEachBorrowerRow(*snapshot, [](const BorrowerInfo& borrower, uint64_t version, const function<vector<LoanInfo>()>& loans) {
+            cout << borrowerRows(borrower, version, loans);
+        });
     }
 
     // Pause to allow the user to see the output
@@ -953,105 +1109,184 @@ void viewBorrowers() {
     cin.get(); // Waits for the user to press Enter
 }
 
-void borrowBook() {
-    int borrowerID, bookID;
-    string date;
+void loansByDateRange() {
+    string from, to;
+    int mode;
+    cout << "\t[1] Loans borrowed in the range\n";
+    cout << "\t[2] Loans out at any time during the range\n";
+    cout << BLUE << BOLD << "\tEnter your choice: " << RESET;
+    cin >> mode;
+    cout << "\tEnter First Date (YYYY-MM-DD): ";
+    cin >> from;
+    cout << "\tEnter Last Date (YYYY-MM-DD): ";
+    cin >> to;
+
+    LoanSpanResult found;
+    if (!cin.fail() && (mode == 1 || mode == 2)) {
+        found = mode == 1 ? loansBorrowedInRange(from, to) : loansOutInRange(from, to);
+    }
+    if (!found.ok) {
+        cin.clear();
+        cout << RED << BOLD << "\tInvalid choice or date. Please enter valid dates (YYYY-MM-DD).\n" << RESET;
+    } else {
+        const vector<LoanSpan>& loans = found.loans;
+
+        cout << BLUE << BOLD << "\n\t==== Loans from " << from << " to " << to << " ====\n" << RESET;
+        cout << "\t--------------------------------------------------------------------------\n";
+        cout << "\t| Borrower  | Book                      | Date Borrowed | Date Returned  |\n";
+        cout << "\t--------------------------------------------------------------------------\n";
+        for (const auto& loan : loans) {
+            cout << "\t| " << left << setw(10) << loan.borrowerID
+                 << "| " << setw(26) << loan.title.substr(0, 25)
+                 << "| " << setw(14) << loan.borrowDate
+                 << "| " << setw(15) << (loan.returnDate.empty() ? "Not Returned" : loan.returnDate) << "|\n";
+        }
+        if (loans.empty()) {
+            cout << "\t| " << left << setw(71) << "No loans in this range." << "|\n";
+        }
+        cout << "\t--------------------------------------------------------------------------\n";
+        cout << "\tLoans: " << loans.size() << "\n";
+    }
 
-    system("CLS");
-    displayLogo();  // Use "clear" for Unix/Linux systems
+    cout << BLUE << BOLD << "\n\tPress Enter to return to the Display Menu..." << RESET;
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    cin.get();
+}
 
-    cout << "\tEnter Borrower ID: ";
-    cin >> borrowerID;
+// Runs at startup; an empty result means there is nothing worth interrupting the user for
+string inventorySummary(const InventoryReport& report) {
+    if (report.clean()) return "";
+    ostringstream out;
+    out << "\tInventory check: " << report.drift.size() << " books with copy counts that do not add up, "
+        << report.dangling.size() << " open loans of missing books, " << report.duplicates.size() << " duplicated book IDs.\n"
+        << "\tSee Display Menu > Inventory Reconciliation for details.\n";
+    return out.str();
+}
 
-    bool borrowerFound = false;
-    for (auto& borrower : borrowers) {
-        if (borrower.id == borrowerID) {
-            borrowerFound = true;
-            break;
-        }
-    }
+void inventoryReconciliation() {
+    auto started = chrono::steady_clock::now();
+    InventoryReport report = reconcileInventory();
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started).count();
 
-    if (!borrowerFound) {
-        cout << RED << BOLD << "\tError: Borrower ID not found. Please enter a valid Borrower ID.\n" << RESET;
-        return;
+    cout << BLUE << BOLD << "\n\t==== Inventory Reconciliation ====\n" << RESET;
+    cout << "\tBooks: " << report.booksChecked << "   Loans: " << report.loansChecked << "   Checked in " << elapsed << " ms\n";
+    if (report.baselined > 0) {
+        cout << "\tBooks without an owned count, given one from today's figures: " << report.baselined << "\n";
     }
 
-    cout << "\tEnter Book ID: ";
-    cin >> bookID;
+    cout << "\n\tBooks whose shelf and loan copies do not add up to the owned count:\n";
+    cout << "\t-------------------------------------------------------------------------------------\n";
+    cout << "\t| Book ID | Title                     | Owned  | Available | On Loan | Difference   |\n";
+    cout << "\t-------------------------------------------------------------------------------------\n";
+    for (const auto& drift : report.drift) {
+        int difference = drift.available + drift.onLoan - drift.owned;
+        cout << "\t| " << left << setw(8) << drift.bookID
+             << "| " << setw(26) << findBookTitle(drift.bookID).substr(0, 25)
+             << "| " << setw(7) << drift.owned
+             << "| " << setw(10) << drift.available
+             << "| " << setw(8) << drift.onLoan
+             << "| " << setw(13) << (difference > 0 ? "+" + to_string(difference) : to_string(difference)) << "|\n";
+    }
+    if (report.drift.empty()) {
+        cout << "\t| " << left << setw(82) << "Every book adds up." << "|\n";
+    }
+    cout << "\t-------------------------------------------------------------------------------------\n";
+
+    cout << "\n\tOpen loans of books that are not in the catalog:\n";
+    cout << "\t-------------------------------------------\n";
+    cout << "\t| Borrower  | Book ID   | Date Borrowed  |\n";
+    cout << "\t-------------------------------------------\n";
+    for (const auto& loan : report.dangling) {
+        cout << "\t| " << left << setw(10) << loan.borrowerID
+             << "| " << setw(10) << loan.bookID
+             << "| " << setw(15) << loan.borrowDate << "|\n";
+    }
+    if (report.dangling.empty()) {
+        cout << "\t| " << left << setw(40) << "None." << "|\n";
+    }
+    cout << "\t-------------------------------------------\n";
 
-    bool bookFound = false;
-    for (auto& book : fictionBooks) {
-        if (book.id == bookID && book.copies > 0) {
-            bookFound = true;
-            break;
+    cout << "\n\tBook IDs filed more than once:\n";
+    for (const auto& duplicate : report.duplicates) {
+        cout << "\t" << duplicate.bookID << ":";
+        for (size_t i = 0; i < duplicate.categories.size(); ++i) {
+            cout << (i ? ", " : " ") << CATEGORY_FILE_NAMES[duplicate.categories[i]];
         }
+        cout << "\n";
     }
-    if (!bookFound) {
-        for (auto& book : nonFictionBooks) {
-            if (book.id == bookID && book.copies > 0) {
-                bookFound = true;
-                break;
-            }
-        }
+    if (report.duplicates.empty()) cout << "\tNone.\n";
 
-        for (auto& book : scienceBooks) {
-            if (book.id == bookID && book.copies > 0) {
-                bookFound = true;
-                break;
-            }
-        }
+    cout << BLUE << BOLD << "\n\tPress Enter to return to the Display Menu..." << RESET;
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    cin.get();
+}
 
-        for (auto& book : mysteryBooks) {
-            if (book.id == bookID && book.copies > 0) {
-                bookFound = true;
-                break;
-            }
-        }
+void overdueReport() {
+    string date;
+    cout << "\tEnter Report Date (YYYY-MM-DD): ";
+    cin >> date;
 
-        for (auto& book : romanceBooks) {
-            if (book.id == bookID && book.copies > 0) {
-                bookFound = true;
-                break;
-            }
+    OverdueResult report = overdueLoans(date);
+    if (!report.ok) {
+        cout << RED << BOLD << "\t" << report.error << "\n" << RESET;
+    } else {
+        cout << BLUE << BOLD << "\n\t==== Overdue Report for " << date << " ====\n" << RESET;
+        cout << "\t-------------------------------------------------------------------------------------------\n";
+        cout << "\t| Borrower  | Book                      | Date Borrowed | Due Date   | Days Late | Fee    |\n";
+        cout << "\t-------------------------------------------------------------------------------------------\n";
+
+        int overdueCount = 0, newlyOverdue = 0;
+        for (const auto& entry : report.loans) {
+            cout << "\t| " << left << setw(10) << entry.borrowerID
+                 << "| " << setw(26) << entry.title.substr(0, 25)
+                 << "| " << setw(14) << entry.borrowDate
+                 << "| " << setw(11) << entry.dueDate
+                 << "| " << setw(10) << entry.daysLate
+                 << "| " << setw(7) << entry.fee << "|\n";
+            overdueCount++;
+            if (entry.daysLate == 1) newlyOverdue++;
         }
-
-        for (auto& book : biographyBooks) {
-            if (book.id == bookID && book.copies > 0) {
-                bookFound = true;
-                break;
-            }
+        if (overdueCount == 0) {
+            cout << "\t| " << left << setw(88) << "No overdue books." << "|\n";
         }
+        cout << "\t-------------------------------------------------------------------------------------------\n";
+        cout << "\tOverdue loans: " << overdueCount << "   Became overdue today: " << newlyOverdue
+             << "   Due today: " << report.dueToday << "\n";
+    }
 
-        for (auto& book : historyBooks) {
-            if (book.id == bookID && book.copies > 0) {
-                bookFound = true;
-                break;
-            }
-        }
+    cout << BLUE << BOLD << "\n\tPress Enter to return to the Display Menu..." << RESET;
+    cin.clear();
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    cin.get();
+}
 
-        for (auto& book : technologyBooks) {
-            if (book.id == bookID && book.copies > 0) {
-                bookFound = true;
-                break;
-            }
-        }
+void borrowBook() {
+    int borrowerID, bookID;
+    string date;
 
-        for (auto& book : childrenBooks) {
-            if (book.id == bookID && book.copies > 0) {
-                bookFound = true;
-                break;
-            }
-        }
+    system("CLS");
+    displayLogo();  // Use "clear" for Unix/Linux systems
 
-        for (auto& book : artBooks) {
-            if (book.id == bookID && book.copies > 0) {
-                bookFound = true;
-                break;
-            }
-        }
+    cout << "\tEnter Borrower ID: ";
+    cin >> borrowerID;
+
+    BorrowerResult borrower = findBorrowerRecord(borrowerID);
+
+    if (!borrower.ok) {
+        cout << RED << BOLD << "\tError: Borrower ID not found. Please enter a valid Borrower ID.\n" << RESET;
+        return;
+    }
+
+    if (borrower.activeLoans >= MAX_ACTIVE_LOANS) {
+        cout << RED << BOLD << "\tError: Borrower already holds " << MAX_ACTIVE_LOANS << " books. Return a book first.\n" << RESET;
+        return;
     }
 
-    if (!bookFound) {
+    cout << "\tEnter Book ID: ";
+    cin >> bookID;
+
+    BookResult found = findBook(bookID);
+    if (!found.ok || found.book.copies <= 0) {
         cout << RED << BOLD << "\tError: Book ID not found or no copies available.\n" << RESET;
         return;
     }
@@ -1069,148 +1304,44 @@ void borrowBook() {
         displayMainMenu();
     }
 
-    for (auto& borrower : borrowers) {
-        if (borrower.id == borrowerID) {
-            // Check Fiction books
-            for (auto& book : fictionBooks) {
-                if (book.id == bookID && book.copies > 0) {
-                    borrower.borrowedBooks.push_back({book.id, date, ""});
-                    book.copies--;
-                    cout << GREEN << BOLD << "\tBook borrowed successfully from Fiction category!\n" << RESET;
-                    displayBorrowedDetails(borrower);
-                    return;
-                }
-            }
-
-            // Repeat for other categories
-            for (auto& book : fictionBooks) {
-                if (book.id == bookID && book.copies > 0) {
-                    borrower.borrowedBooks.push_back({book.id, date, ""});
-                    book.copies--;
-                    cout << GREEN << BOLD << "\tBook borrowed successfully from Non-Fiction category!\n" << RESET;
-                    displayBorrowedDetails(borrower);
-                    return;
-                }
-            }
-
-            for (auto& book : nonFictionBooks) {
-                if (book.id == bookID && book.copies > 0) {
-                    borrower.borrowedBooks.push_back({book.id, date, ""});
-                    book.copies--;
-                    cout << GREEN << BOLD << "\tBook borrowed successfully from Non-Fiction category!\n" << RESET;
-                    displayBorrowedDetails(borrower);
-                    return;
-                }
-            }
-            for (auto& book : scienceBooks) {
-                if (book.id == bookID && book.copies > 0) {
-                    borrower.borrowedBooks.push_back({book.id, date, ""});
-                    book.copies--;
-                    cout << GREEN << BOLD << "\tBook borrowed successfully from Science category!\n" << RESET;
-                    displayBorrowedDetails(borrower);
-                    return;
-                }
-            }
-            for (auto& book : mysteryBooks) {
-                if (book.id == bookID && book.copies > 0) {
-                    borrower.borrowedBooks.push_back({book.id, date, ""});
-                    book.copies--;
-                    cout << GREEN << BOLD << "\tBook borrowed successfully from Mystery category!\n" << RESET;
-                    displayBorrowedDetails(borrower);
-                    return;
-                }
-            }
-            for (auto& book : romanceBooks) {
-                if (book.id == bookID && book.copies > 0) {
-                    borrower.borrowedBooks.push_back({book.id, date, ""});
-                    book.copies--;
-                    cout << GREEN << BOLD << "\tBook borrowed successfully from Romance category!\n" << RESET;
-                    displayBorrowedDetails(borrower);
-                    return;
-                }
-            }
-
-            for (auto& book : biographyBooks) {
-                if (book.id == bookID && book.copies > 0) {
-                    borrower.borrowedBooks.push_back({book.id, date, ""});
-                    book.copies--;
-                    cout << GREEN << BOLD << "\tBook borrowed successfully from Biography category!\n" << RESET;
-                    displayBorrowedDetails(borrower);
-                    return;
-                }
-            }
-            for (auto& book : historyBooks) {
-                if (book.id == bookID && book.copies > 0) {
-                    borrower.borrowedBooks.push_back({book.id, date, ""});
-                    book.copies--;
-                    cout << GREEN << BOLD << "\tBook borrowed successfully from History category!\n" << RESET;
-                    displayBorrowedDetails(borrower);
-                    return;
-                }
-            }
-            for (auto& book : technologyBooks) {
-                if (book.id == bookID && book.copies > 0) {
-                    borrower.borrowedBooks.push_back({book.id, date, ""});
-                    book.copies--;
-                    cout << GREEN << BOLD << "\tBook borrowed successfully from Technology category!\n" << RESET;
-                    displayBorrowedDetails(borrower);
-                    return;
-                }
-            }
-            for (auto& book : childrenBooks) {
-                if (book.id == bookID && book.copies > 0) {
-                    borrower.borrowedBooks.push_back({book.id, date, ""});
-                    book.copies--;
-                    cout << GREEN << BOLD << "\tBook borrowed successfully from Children category!\n" << RESET;
-                    displayBorrowedDetails(borrower);
-                    return;
-                }
-            }
-            for (auto& book : artBooks) {
-                if (book.id == bookID && book.copies > 0) {
-                    borrower.borrowedBooks.push_back({book.id, date, ""});
-                    book.copies--;
-                    cout << GREEN << BOLD << "\tBook borrowed successfully from Art category!\n" << RESET;
-                    displayBorrowedDetails(borrower);
-                    return;
-                }
-            }
-
-            cout << RED << BOLD << "\tBook not found or no copies available in any category.\n" << RESET;
-            return;
-        }
+    LoanResult loan = checkOut(borrowerID, {bookID}, date);
+    if (!loan.ok) {
+        cout << RED << BOLD << "\tBorrowing failed. " << loan.error << "\n" << RESET;
+        return;
     }
+    cout << GREEN << BOLD << "\tBook borrowed successfully from " << CATEGORY_NAMES[found.category] << " category!\n" << RESET;
+    displayAlsoBorrowed(bookID);
+    displayBorrowedDetails(findBorrowerRecord(borrowerID));
+}
 
-    cout << RED << BOLD << "\tBorrowing failed. Borrower ID not found.\n" << RESET;
+// Recommendations shown at the desk after a checkout
+void displayAlsoBorrowed(int bookID) {
+    SearchResult also = patronsAlsoBorrowed(bookID);
+    if (also.rows.empty()) return;
+    cout << CYAN << BOLD << "\n\tPatrons who borrowed \"" << findBookTitle(bookID) << "\" also borrowed:\n" << RESET;
+    for (const auto& row : also.rows) {
+        cout << "\t  " << setw(10) << left << row.book.id << row.book.title
+             << " (" << CATEGORY_NAMES[row.category] << ", " << row.book.copies << " available)\n";
+    }
+    cout << "\n";
 }
 
 // Function definition for displaying borrower details
-void displayBorrowedDetails(const Borrower& borrower) {
+void displayBorrowedDetails(const BorrowerResult& record) {
+    const BorrowerInfo& borrower = record.borrower;
     cout << "\t--------------------------------------------------------------\n";
     cout << "\t| Borrower Name       | Book Title          | Date Borrowed  |\n";
     cout << "\t--------------------------------------------------------------\n";
 
-    if (borrower.borrowedBooks.empty()) {
+    if (record.loans.empty()) {
     cout << "\t| " << left << setw(58) << "No books borrowed yet." << " |\n";
     cout << "\t--------------------------------------------------------------\n";
     } else {
     // If there are borrowed books, print them
-        for (const auto& borrowedBook : borrower.borrowedBooks) {
-            string bookTitle;
-            for (const auto& category : {fictionBooks, nonFictionBooks, scienceBooks, mysteryBooks, romanceBooks,
-                                            biographyBooks, historyBooks, technologyBooks, childrenBooks, artBooks}) {
-                auto it = find_if(category.begin(), category.end(), [&borrowedBook](const Book& b) {
-                    return b.id == borrowedBook.id;
-                });
-                if (it != category.end()) {
-                    bookTitle = it->title;
-                    break;
-                }
-            }
-
+        for (const auto& borrowedBook : record.loans) {
             cout << "\t| " << left << setw(20) << borrower.firstName + " " + borrower.middleInitial + " " + borrower.lastName
-                 << "| " << setw(20) << bookTitle
-                 << "| " << setw(14) << borrowedBook.dateBorrow << " |\n";
+                 << "| " << setw(20) << borrowedBook.title
+                 << "| " << setw(14) << borrowedBook.borrowDate << " |\n";
         }
         cout << "\t--------------------------------------------------------------\n";
     cin.clear();
@@ -1221,6 +1352,81 @@ void displayBorrowedDetails(const Borrower& borrower) {
     }
 }
 
+// Book IDs separated by spaces or commas
+vector<int> parseBookIDList(const string& line) {
+    vector<int> ids;
+    string text = line;
+    replace(text.begin(), text.end(), ',', ' ');
+    stringstream ss(text);
+    string token;
+    while (ss >> token) {
+        try {
+            ids.push_back(stoi(token));
+        } catch (const exception& e) {
+            return {};
+        }
+    }
+    return ids;
+}
+
+void batchTransaction() {
+    int choice, borrowerID;
+    string idLine, date;
+
+    system("CLS");
+    displayLogo();
+    cout << BLUE << BOLD << "\n\t==== Borrow or Return Several Books ====\n" << RESET;
+    cout << "\t[1] Borrow Books\n";
+    cout << "\t[2] Return Books\n";
+    cout << BLUE << BOLD << "\tEnter your choice: " << RESET;
+    cin >> choice;
+    cout << "\tEnter Borrower ID: ";
+    cin >> borrowerID;
+    if (cin.fail() || (choice != 1 && choice != 2)) {
+        cin.clear();
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        cout << RED << BOLD << "\tInvalid choice.\n" << RESET;
+        return;
+    }
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    cout << "\tEnter Book IDs (separated by spaces): ";
+    getline(cin, idLine);
+    cout << "\tEnter Date of " << (choice == 1 ? "Borrow" : "Return") << " (YYYY-MM-DD): ";
+    getline(cin, date);
+
+    vector<int> bookIDs = parseBookIDList(idLine);
+    LoanResult result = choice == 1 ? checkOut(borrowerID, bookIDs, date) : checkIn(borrowerID, bookIDs, date);
+    const vector<int>& fees = result.fees;
+    if (!result.ok) {
+        cout << RED << BOLD << "\t" << result.error << " Nothing was " << (choice == 1 ? "borrowed" : "returned") << ".\n" << RESET;
+    } else if (choice == 1) {
+        cout << GREEN << BOLD << "\t" << bookIDs.size() << " book(s) borrowed successfully!\n" << RESET;
+        set<int> shown;
+        for (int id : bookIDs) {
+            if (shown.insert(id).second) displayAlsoBorrowed(id);
+        }
+        displayBorrowedDetails(findBorrowerRecord(borrowerID));
+        return;
+    } else {
+        int total = 0;
+        cout << GREEN << BOLD << "\t" << bookIDs.size() << " book(s) returned successfully.\n" << RESET;
+        cout << "\t----------------------------------------------------\n";
+        cout << "\t| ID        | Title                      | Fee     |\n";
+        cout << "\t----------------------------------------------------\n";
+        for (size_t i = 0; i < bookIDs.size(); ++i) {
+            cout << "\t| " << setw(10) << right << bookIDs[i] << "| "
+                 << setw(25) << left << findBookTitle(bookIDs[i]).substr(0, 25) << "  | "
+                 << setw(7) << right << fees[i] << " |\n";
+            total += fees[i];
+        }
+        cout << "\t----------------------------------------------------\n";
+        cout << "\tTotal overdue fees: " << total << " pesos\n";
+    }
+
+    cout << BLUE << BOLD << "\n\tPress Enter to return to the main menu..." << RESET;
+    cin.get();
+}
+
 void returnBook() {
     int borrowerID, bookID;
     string returnDate;
@@ -1232,13 +1438,7 @@ void returnBook() {
     cin >> borrowerID;
 
     // Check if the borrower ID is valid
-    bool borrowerFound = false;
-    for (auto& borrower : borrowers) {
-        if (borrower.id == borrowerID) {
-            borrowerFound = true;
-            break;
-        }
-    }
+    bool borrowerFound = findBorrowerRecord(borrowerID).ok;
 
         if (!borrowerFound) {
             cout << RED << BOLD << "\tError: Borrower ID is not valid.\n" << RESET;
@@ -1254,21 +1454,7 @@ void returnBook() {
     cin >> bookID;
 
     // Check if the book ID is valid in any book category
-    bool bookFound = false;
-    for (auto& category : {fictionBooks, nonFictionBooks, scienceBooks, mysteryBooks, romanceBooks,
-                           biographyBooks, historyBooks, technologyBooks, childrenBooks, artBooks}) {
-        for (auto& book : category) {
-            if (book.id == bookID) {
-                bookFound = true;
-                break;
-            }
-        }
-        if (bookFound) {
-            break;
-        }
-    }
-
-    if (!bookFound) {
+    if (!findBook(bookID).ok) {
         cout << RED << BOLD << "\tError: Book ID is not valid or not found in the inventory.\n" << RESET;
         cin.clear();
         cout << BLUE << BOLD << "\n\tPress Enter to return to the main menu..." << RESET;
@@ -1282,156 +1468,59 @@ void returnBook() {
     cout << "\tEnter Date of Return (YYYY-MM-DD): ";
     getline(cin, returnDate);
 
-    // Iterate through the list of borrowers
-    for (auto& borrower : borrowers) {
-        if (borrower.id == borrowerID && !borrower.borrowedBooks.empty()) {  // Check if the borrower exists and has borrowed books
-            bool bookFoundInBorrowedBooks = false;
-
-            // Find the book that matches the bookID in the borrower's list of borrowed books
-            for (auto& borrowedBook : borrower.borrowedBooks) {
-                if (bookFoundInBorrowedBooks) break;
-                if (borrowedBook.id == bookID && borrowedBook.dateReturn == "") {
-
-                    int overdueFee = calculateOverdueFee(borrowedBook.dateBorrow, returnDate);  // Calculate the overdue fee
-                    borrowedBook.dateReturn = returnDate;  // Set the return date
-                    borrowedBook.overdueFee = overdueFee;  // Update the borrower's overdue fee
-
-                    if (overdueFee == 0) {
-                        // Case 1: On-time return
-                        cout << GREEN << BOLD << "\tBook returned SUCCESSFULLY.\n" << RESET;
-
-                        displayBorrowerTableHeader();
-
-                        // Display the borrower details using displayBorrowerTable
-                        displayBorrowerTable(borrower);
-
-                            cin.clear();
-                            cout << BLUE << BOLD << "\n\tPress Enter to return to the main menu...";
-                            cin.get();  // Wait for the user to press Enter
-                            //system("CLS");  // Use "clear" for Unix/Linux systems
-                            //displayMainMenu();
-                    } else {
-                        string bookTitle;
-                        for (const auto& category : {fictionBooks, nonFictionBooks, scienceBooks, mysteryBooks, romanceBooks,
-                                                    biographyBooks, historyBooks, technologyBooks, childrenBooks, artBooks}) {
-                            auto it = find_if(category.begin(), category.end(), [&borrowedBook](const Book& b) {
-                                return b.id == borrowedBook.id;
-                            });
-                            if (it != category.end()) {
-                                bookTitle = it->title;
-                                break;
-                            }
-                        }
-
-                        // Case 2: Late return with fee
-                        cout << GREEN << BOLD << "\tBook returned SUCCESSFULLY." << RESET;
-                        cout << RED << BOLD << "But, you need to pay for not following the rules.\n" << RESET;
-                        cout << CYAN << BOLD << "\n\t--- E-Receipt ---\n" << RESET;
-                        cout << "\tBorrower's Name: " << borrower.firstName + " " + borrower.middleInitial + " " + borrower.lastName << "\n";
-                        cout << "\tBook Title: " << bookTitle << "\n";
-                        cout << "\tDate Borrowed: " << borrowedBook.dateBorrow << "\n";
-                        cout << "\tDate Returned: " << borrowedBook.dateReturn << "\n";
-                        cout << RED << BOLD << "\tOverdue Fee: " << overdueFee << " pesos\n" << RESET;
-                        cout << "\t------------------\n";
-                        cin.clear();
-                        cout << BLUE << BOLD << "\n\tPress Enter to return to the main menu..." << RESET;
-                        cin.get();  // Wait for the user to press Enter
-                    }
-
-                    // Return the book to inventory
-                    for (auto& book : fictionBooks) {  // Repeat for all categories
-                        if (book.id == bookID) {
-                            book.copies++;  // Increase the available copies
-                            system("CLS");  // Use "clear" for Unix/Linux systems
-                            displayMainMenu();
-                            return;
-                        }
-                    }
-
-                    for (auto& book : nonFictionBooks) {  // Repeat for all categories
-                        if (book.id == bookID) {
-                            book.copies++;  // Increase the available copies
-                            system("CLS");  // Use "clear" for Unix/Linux systems
-                            displayMainMenu();
-                            return;
-                        }
-                    }
-
-                    for (auto& book : scienceBooks) {  // Repeat for all categories
-                        if (book.id == bookID) {
-                            book.copies++;  // Increase the available copied
-                            system("CLS");  // Use "clear" for Unix/Linux systems
-                            displayMainMenu();
-                            return;
-                        }
-                    }
-
-                    for (auto& book : mysteryBooks) {  // Repeat for all categories
-                        if (book.id == bookID) {
-                            book.copies++;  // Increase the available copied
-                            system("CLS");  // Use "clear" for Unix/Linux systems
-                            displayMainMenu();
-                            return;
-                        }
-                    }
-
-                    for (auto& book : romanceBooks) {  // Repeat for all categories
-                        if (book.id == bookID) {
-                            book.copies++;  // Increase the available copies
-                            system("CLS");  // Use "clear" for Unix/Linux systems
-                            displayMainMenu();
-                            return;
-                        }
-                    }
+    BorrowerResult borrowerRecord = findBorrowerRecord(borrowerID);
+    if (borrowerRecord.ok && !borrowerRecord.loans.empty()) {
+        const BorrowerInfo& borrower = borrowerRecord.borrower;
 
-                    for (auto& book : biographyBooks) {  // Repeat for all categories
-                        if (book.id == bookID) {
-                            book.copies++;  // Increase the available copies
-                            system("CLS");  // Use "clear" for Unix/Linux systems
-                            displayMainMenu();
-                            return;
-                        }
-                    }
+        // Find the open loan that matches the bookID in the borrower's history
+        bool openLoan = any_of(borrowerRecord.loans.begin(), borrowerRecord.loans.end(), [bookID](const LoanInfo& loan) {
+            return loan.bookID == bookID && loan.returnDate.empty();
+        });
+        if (openLoan) {
+            LoanResult loan = checkIn(borrowerID, {bookID}, returnDate);
+            if (!loan.ok) {
+                cout << RED << BOLD << "\t" << loan.error << "\n" << RESET;
+                cin.clear();
+                cout << BLUE << BOLD << "\n\tPress Enter to return to the main menu..." << RESET;
+                cin.get();
+                return;
+            }
+            int overdueFee = loan.fees[0];
+            const LoanInfo& borrowedBook = loan.loans[0];
 
-                    for (auto& book : historyBooks) {  // Repeat for all categories
-                        if (book.id == bookID) {
-                            book.copies++;  // Increase the available copies
-                            system("CLS");  // Use "clear" for Unix/Linux systems
-                            displayMainMenu();
-                            return;
-                        }
-                    }
+            if (overdueFee == 0) {
+                // Case 1: On-time return
+                cout << GREEN << BOLD << "\tBook returned SUCCESSFULLY.\n" << RESET;
 
-                    for (auto& book : technologyBooks) {  // Repeat for all categories
-                        if (book.id == bookID) {
-                            book.copies++;  // Increase the available copies
-                            system("CLS");  // Use "clear" for Unix/Linux systems
-                            displayMainMenu();
-                            return;
-                        }
-                    }
+                displayBorrowerTableHeader();
 
-                    for (auto& book : childrenBooks) {  // Repeat for all categories
-                        if (book.id == bookID) {
-                            book.copies++;  // Increase the available copies
-                            system("CLS");  // Use "clear" for Unix/Linux systems
-                            displayMainMenu();
-                            return;
-                        }
-                    }
+                // Display the borrower details using displayBorrowerTable
+                displayBorrowerTable(findBorrowerRecord(borrowerID));
 
-                    for (auto& book : artBooks) {  // Repeat for all categories
-                        if (book.id == bookID) {
-                            book.copies++;  // Increase the available copies
-                            system("CLS");  // Use "clear" for Unix/Linux systems
-                            displayMainMenu();
-                            return;
-                        }
-                    }
-                    cout << RED << BOLD << "Book not found in the library inventory.\n" << RESET;
-                    return;
-                }
+                    cin.clear();
+                    cout << BLUE << BOLD << "\n\tPress Enter to return to the main menu...";
+                    cin.get();  // Wait for the user to press Enter
+                    //system("CLS");  // Use "clear" for Unix/Linux systems
+                    //displayMainMenu();
+            } else {
+                // Case 2: Late return with fee
+                cout << GREEN << BOLD << "\tBook returned SUCCESSFULLY." << RESET;
+                cout << RED << BOLD << "But, you need to pay for not following the rules.\n" << RESET;
+                cout << CYAN << BOLD << "\n\t--- E-Receipt ---\n" << RESET;
+                cout << "\tBorrower's Name: " << borrower.firstName + " " + borrower.middleInitial + " " + borrower.lastName << "\n";
+                cout << "\tBook Title: " << borrowedBook.title << "\n";
+                cout << "\tDate Borrowed: " << borrowedBook.borrowDate << "\n";
+                cout << "\tDate Returned: " << borrowedBook.returnDate << "\n";
+                cout << RED << BOLD << "\tOverdue Fee: " << overdueFee << " pesos\n" << RESET;
+                cout << "\t------------------\n";
+                cin.clear();
+                cout << BLUE << BOLD << "\n\tPress Enter to return to the main menu..." << RESET;
+                cin.get();  // Wait for the user to press Enter
             }
+
+            system("CLS");  // Use "clear" for Unix/Linux systems
+            displayMainMenu();
+            return;
         }
     }
 
@@ -1441,43 +1530,3 @@ void returnBook() {
     cout << BLUE << BOLD << "\n\tPress Enter to return to the main menu..." << RESET;
     cin.get();  // Wait for the user to press Enter
 }
-
-
-int daysSinceStartOfYear(int year, int month, int day) {
-    static const int daysInMonth[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
-    int totalDays = 0;
-
-    // Add days of months in the same year
-    for (int i = 0; i < month - 1; ++i) {
-        totalDays += daysInMonth[i];
-    }
-
-    // Add the current month's days
-    totalDays += day;
-
-    // Handle leap years for February
-    if (month > 2 && ((year % 4 == 0 && year % 100 != 0) || (year % 400 == 0))) {
-        totalDays += 1; // Leap day
-    }
-
-    return totalDays;
-}
-
-int daysFromDate(const string& date) {
-    int year, month, day;
-    sscanf(date.c_str(), "%d-%d-%d", &year, &month, &day);
-
-    // Calculate total days since 1900-01-01
-    int totalDays = (year - 1900) * 365 + (year - 1900) / 4 - (year - 1900) / 100 + (year - 1900) / 400;
-    totalDays += daysSinceStartOfYear(year, month, day);
-    return totalDays;
-}
-
-int calculateOverdueFee(const string& borrowDate, const string& returnDate) {
-    int borrowDays = daysFromDate(borrowDate);
-    int returnDays = daysFromDate(returnDate);
-    int daysBorrowed = returnDays - borrowDays;
-    int maxDays = 7;
-    int overdueDays = max(0, daysBorrowed - maxDays);
-    return overdueDays * 5; // Fee of 5 pesos per day
-}